@@ -0,0 +1,57 @@
+#include "alias_table.h"
+
+/**
+ * Vose's algorithm on weights scaled by size, so that the average column
+ * holds exactly total and no rounding ever happens
+ */
+uint64_t build_alias_table(const uint32_t *weights, uint32_t size,
+                           uint32_t *threshold, uint32_t *alias,
+                           uint64_t *scaled_scratch, uint32_t *index_scratch) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        total += weights[i];
+    }
+
+    // Small columns are stacked from the front of index_scratch, large
+    // ones from the back
+    uint32_t small_count = 0;
+    uint32_t large_start = size;
+    for (uint32_t i = 0; i < size; i++) {
+        scaled_scratch[i] = (uint64_t)weights[i] * size;
+        if (scaled_scratch[i] < total) {
+            index_scratch[small_count++] = i;
+        } else {
+            index_scratch[--large_start] = i;
+        }
+    }
+
+    while (small_count > 0 && large_start < size) {
+        uint32_t small = index_scratch[--small_count];
+        uint32_t large = index_scratch[large_start++];
+
+        threshold[small] = (uint32_t)scaled_scratch[small];
+        alias[small] = large;
+
+        // The large column gives away what fills the small one up to total
+        scaled_scratch[large] -= total - scaled_scratch[small];
+        if (scaled_scratch[large] < total) {
+            index_scratch[small_count++] = large;
+        } else {
+            index_scratch[--large_start] = large;
+        }
+    }
+
+    // Whatever is left holds exactly total and always picks itself
+    while (large_start < size) {
+        uint32_t large = index_scratch[large_start++];
+        threshold[large] = (uint32_t)total;
+        alias[large] = large;
+    }
+    while (small_count > 0) {
+        uint32_t small = index_scratch[--small_count];
+        threshold[small] = (uint32_t)total;
+        alias[small] = small;
+    }
+
+    return total;
+}
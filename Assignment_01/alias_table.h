@@ -0,0 +1,44 @@
+#ifndef _ALIAS_TABLE_H_
+#define _ALIAS_TABLE_H_
+
+#include <stdint.h> // For uint32_t, uint64_t
+
+/**
+ * Walker/Vose alias tables over integer weights.
+ *
+ * A table for n weights summing to total is two arrays of n entries. To
+ * sample, pick a column j uniformly in [0, n) and a number r uniformly in
+ * [0, total): the result is j if r < threshold[j], alias[j] otherwise.
+ * All arithmetic is done on integers, so every index i is returned with
+ * probability exactly weights[i] / total.
+ */
+
+/**
+ * Build the alias table of the given weights.
+ * @param weights the weights, all positive
+ * @param size number of weights
+ * @param threshold output array of size entries, values in [0, total]
+ * @param alias output array of size entries
+ * @param scaled_scratch scratch space of size entries
+ * @param index_scratch scratch space of size entries
+ * @return the total of the weights
+ */
+uint64_t build_alias_table(const uint32_t *weights, uint32_t size,
+                           uint32_t *threshold, uint32_t *alias,
+                           uint64_t *scaled_scratch, uint32_t *index_scratch);
+
+/**
+ * Resolve one sample from two uniform numbers.
+ * @param threshold thresholds of the table
+ * @param alias aliases of the table
+ * @param column uniform number in [0, size)
+ * @param coin uniform number in [0, total)
+ * @return the sampled index
+ */
+static inline uint32_t sample_alias_table(const uint32_t *threshold,
+                                          const uint32_t *alias,
+                                          uint32_t column, uint32_t coin) {
+    return coin < threshold[column] ? column : alias[column];
+}
+
+#endif /* _ALIAS_TABLE_H_ */
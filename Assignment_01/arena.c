@@ -0,0 +1,104 @@
+#include "arena.h"
+#include <stdlib.h> // For malloc()
+#include <string.h> // For memcpy()
+
+// Alignment good enough for every object stored in the arena
+#define ARENA_ALIGNMENT (sizeof(long double) > sizeof(void *) ? \
+                         sizeof(long double) : sizeof(void *))
+
+// The header is padded so that the data after it is aligned
+#define BLOCK_HEADER_SIZE ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & \
+                           ~(ARENA_ALIGNMENT - 1))
+
+/**
+ * Initialize an empty arena
+ */
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->bytes_reserved = 0;
+}
+
+/**
+ * Allocate a new block with room for at least size bytes
+ */
+static ArenaBlock *new_block(Arena *arena, size_t size) {
+    size_t block_size = arena->block_size;
+    if (size > block_size) {
+        block_size = size;
+    }
+
+    ArenaBlock *block = malloc(BLOCK_HEADER_SIZE + block_size);
+    if (!block) {
+        return NULL;
+    }
+    block->size = block_size;
+    block->used = 0;
+    arena->bytes_reserved += BLOCK_HEADER_SIZE + block_size;
+    return block;
+}
+
+/**
+ * Allocate size bytes aligned to alignment (a power of two) from the
+ * current block, starting a new one when it is full
+ */
+static void *alloc_aligned(Arena *arena, size_t size, size_t alignment) {
+    ArenaBlock *block = arena->head;
+    size_t offset = 0;
+    if (block) {
+        offset = (block->used + alignment - 1) & ~(alignment - 1);
+    }
+
+    if (!block || offset > block->size || block->size - offset < size) {
+        block = new_block(arena, size);
+        if (!block) {
+            return NULL;
+        }
+        if (size > arena->block_size && arena->head) {
+            // Oversized objects get a private block behind the current one
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            block->next = arena->head;
+            arena->head = block;
+        }
+        offset = 0;
+    }
+
+    block->used = offset + size;
+    return (char *)block + BLOCK_HEADER_SIZE + offset;
+}
+
+/**
+ * Allocate memory aligned for any object
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+    return alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+/**
+ * Copy a word into the arena, words are packed without padding
+ */
+char *arena_strndup(Arena *arena, const char *word, size_t length) {
+    char *copy = alloc_aligned(arena, length + 1, 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, word, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * Free all blocks
+ */
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->bytes_reserved = 0;
+}
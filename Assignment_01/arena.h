@@ -0,0 +1,55 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h> // For size_t
+
+#define ARENA_DEFAULT_BLOCK_SIZE (1 << 20)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+/**
+ * Bump allocator carving objects out of large blocks. Objects cannot be
+ * freed one by one, everything is released at once by arena_free().
+ */
+typedef struct Arena {
+    ArenaBlock *head;       // block currently allocated from
+    size_t block_size;      // size of new blocks
+    size_t bytes_reserved;  // total size of all blocks
+} Arena;
+
+/**
+ * Initialize an empty arena, no memory is allocated until the first use.
+ * @param arena arena to initialize
+ * @param block_size size of the blocks to allocate, 0 for the default
+ */
+void arena_init(Arena *arena, size_t block_size);
+
+/**
+ * Allocate size bytes, aligned for any object type.
+ * @param arena arena to allocate from
+ * @param size number of bytes to allocate
+ * @return pointer to the memory, NULL in case of allocation failure
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * Copy length bytes of word into the arena and NUL terminate the copy.
+ * @param arena arena to allocate from
+ * @param word bytes to copy
+ * @param length number of bytes to copy
+ * @return the copy, NULL in case of allocation failure
+ */
+char *arena_strndup(Arena *arena, const char *word, size_t length);
+
+/**
+ * Free all blocks of the arena, invalidating every pointer it handed out.
+ * The arena can be used again afterwards.
+ * @param arena arena to free
+ */
+void arena_free(Arena *arena);
+
+#endif /* _ARENA_H_ */
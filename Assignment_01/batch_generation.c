@@ -0,0 +1,131 @@
+#include "batch_generation.h"
+#include <pthread.h>
+
+/**
+ * A contiguous range of tweets generated by one thread into memory
+ */
+typedef struct GenerationJob {
+    const FrozenChain *frozen_chain;
+    uint64_t seed;
+    long first;     // first tweet number of the range
+    long count;
+    OutputBuffer output;   // the range's lines
+    int failed;
+} GenerationJob;
+
+/**
+ * Generate a range of tweets, each from its own stream, FROZEN_WALK_BATCH
+ * interleaved walks at a time
+ */
+int generate_tweet_range(const FrozenChain *frozen_chain, uint64_t seed,
+                         long first, long count, OutputBuffer *out) {
+    if (!frozen_chain || !out) {
+        return 1;
+    }
+
+    FrozenWalkBatch batch;
+    for (long group = first; group < first + count;
+         group += FROZEN_WALK_BATCH) {
+        long remaining = first + count - group;
+        batch.count = remaining < FROZEN_WALK_BATCH ? (uint32_t)remaining :
+                      FROZEN_WALK_BATCH;
+        for (uint32_t k = 0; k < batch.count; k++) {
+            rng_seed(&batch.rngs[k], seed, (uint64_t)(group + k));
+            uint32_t first_id = frozen_chain_random_first(frozen_chain,
+                                                          &batch.rngs[k]);
+            batch.ids[k][0] = first_id;
+            batch.words[k] = first_id == FROZEN_NO_NODE ? 0 : 1;
+        }
+        frozen_run_walks(frozen_chain, &batch);
+
+        // Only tweets that ended properly get a line
+        for (uint32_t k = 0; k < batch.count; k++) {
+            if (batch.words[k] <= 0) {
+                continue;
+            }
+            size_t start = out->length;
+            char prefix[32];
+            int prefix_length = snprintf(prefix, sizeof(prefix),
+                                         "Tweet %ld: ", group + (long)k);
+            if (output_buffer_append(out, prefix, prefix_length) != 0 ||
+                frozen_append_walk(frozen_chain, &batch, k, out, NULL) < 0) {
+                output_buffer_truncate(out, start);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Thread function: generate a range of tweets into the job's buffer
+ */
+static void* generate_range(void *arg) {
+    GenerationJob *job = arg;
+    job->failed = generate_tweet_range(job->frozen_chain, job->seed,
+                                       job->first, job->count, &job->output);
+    return NULL;
+}
+
+/**
+ * Generate the tweets in rounds, each split evenly between the threads
+ */
+int generate_tweets_batch(const FrozenChain *frozen_chain, uint64_t seed,
+                          long tweets_count, int num_threads,
+                          OutputBuffer *out) {
+    if (!frozen_chain || !out || num_threads < 1 ||
+        num_threads > MAX_GENERATION_THREADS) {
+        return 1;
+    }
+
+    GenerationJob jobs[MAX_GENERATION_THREADS];
+    pthread_t threads[MAX_GENERATION_THREADS];
+    bool started[MAX_GENERATION_THREADS];
+    int failed = 0;
+
+    for (long round = 1; round <= tweets_count && !failed;
+         round += BATCH_ROUND_TWEETS) {
+        long round_count = tweets_count - round + 1;
+        if (round_count > BATCH_ROUND_TWEETS) {
+            round_count = BATCH_ROUND_TWEETS;
+        }
+
+        long first = round;
+        for (int t = 0; t < num_threads; t++) {
+            long count = round_count / num_threads +
+                         (t < round_count % num_threads ? 1 : 0);
+            jobs[t] = (GenerationJob) {frozen_chain, seed, first, count,
+                                       {0}, 0};
+            output_buffer_init(&jobs[t].output, OUTPUT_BUFFER_NO_FD, 0);
+            first += count;
+        }
+
+        // Job 0 runs on the calling thread
+        for (int t = 1; t < num_threads; t++) {
+            started[t] = pthread_create(&threads[t], NULL, generate_range,
+                                        &jobs[t]) == 0;
+        }
+        generate_range(&jobs[0]);
+        for (int t = 1; t < num_threads; t++) {
+            if (started[t]) {
+                pthread_join(threads[t], NULL);
+            } else {
+                generate_range(&jobs[t]);
+            }
+        }
+
+        // Ranges are printed in order, whatever order they finished in
+        for (int t = 0; t < num_threads; t++) {
+            failed = failed || jobs[t].failed;
+            if (!failed &&
+                (output_buffer_append(out, jobs[t].output.data,
+                                      jobs[t].output.length) != 0 ||
+                 output_buffer_maybe_flush(out) != 0)) {
+                failed = 1;
+            }
+            output_buffer_free(&jobs[t].output);
+        }
+    }
+
+    return failed;
+}
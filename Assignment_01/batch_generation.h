@@ -0,0 +1,44 @@
+#ifndef _BATCH_GENERATION_H_
+#define _BATCH_GENERATION_H_
+
+#include "frozen_chain.h"
+
+#define MAX_GENERATION_THREADS 64
+#define BATCH_ROUND_TWEETS 65536
+
+/**
+ * Generate tweets first..first + count - 1 on the calling thread and
+ * append them to an output buffer as "Tweet <i>: <text>" lines. Tweet i
+ * draws from its own Rng stream seeded from (seed, i), so a range gives
+ * the same lines as in generate_tweets_batch(). The buffer is not flushed.
+ * @param frozen_chain the chain, only read
+ * @param seed the user's seed
+ * @param first number of the first tweet
+ * @param count number of tweets to generate
+ * @param out buffer to append the tweets to
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int generate_tweet_range(const FrozenChain *frozen_chain, uint64_t seed,
+                         long first, long count, OutputBuffer *out);
+
+/**
+ * Generate tweets 1..tweets_count from a frozen chain on several threads
+ * and append them to an output buffer as "Tweet <i>: <text>" lines, in
+ * order. The buffer is flushed as it fills up.
+ *
+ * The chain is shared read-only. Tweet i draws from its own Rng stream
+ * seeded from (seed, i), so the output only depends on the seed and not
+ * on the number of threads. Tweets that fail to generate are skipped,
+ * like in the serial loop.
+ * @param frozen_chain the chain
+ * @param seed the user's seed
+ * @param tweets_count number of tweets to generate
+ * @param num_threads number of worker threads, 1 to MAX_GENERATION_THREADS
+ * @param out buffer to append the tweets to
+ * @return 0 on success, 1 in case of failure
+ */
+int generate_tweets_batch(const FrozenChain *frozen_chain, uint64_t seed,
+                          long tweets_count, int num_threads,
+                          OutputBuffer *out);
+
+#endif /* _BATCH_GENERATION_H_ */
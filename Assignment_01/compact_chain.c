@@ -0,0 +1,335 @@
+#include "compact_chain.h"
+
+/**
+ * Scratch space and per-node results of select_edges()
+ */
+typedef struct EdgeSelection {
+    uint32_t *positions;  // kept positions in the frequency list
+    uint32_t *counts;     // their (possibly scaled) counts
+    uint32_t *sorted;     // scratch for capping the degree
+    uint32_t size;
+    uint64_t total;       // of the scaled counts
+    bool quantized;
+} EdgeSelection;
+
+/**
+ * Sort counts in decreasing order
+ */
+static int compare_counts(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Pick the edges of a kept node and scale their counts to 16 bits.
+ * The selection only depends on the node, so both passes agree.
+ */
+static void select_edges(const MarkovNode *node, const uint32_t *new_ids,
+                         uint32_t min_count, EdgeSelection *selection) {
+    selection->size = 0;
+    selection->quantized = false;
+    uint64_t total = 0;
+    for (int i = 0; i < node->frequency_list_size; i++) {
+        const MarkovNodeFrequency *entry = &node->frequency_list[i];
+        if ((uint32_t)entry->frequency >= min_count &&
+            new_ids[entry->markov_node->id] != FROZEN_NO_NODE) {
+            selection->positions[selection->size] = (uint32_t)i;
+            selection->counts[selection->size++] = (uint32_t)entry->frequency;
+            total += (uint32_t)entry->frequency;
+        }
+    }
+
+    // Too many successors: keep the most frequent, earliest first on ties
+    if (selection->size > FROZEN_COMPACT_MAX_TOTAL) {
+        memcpy(selection->sorted, selection->counts,
+               selection->size * sizeof(uint32_t));
+        qsort(selection->sorted, selection->size, sizeof(uint32_t),
+              compare_counts);
+        uint32_t cutoff = selection->sorted[FROZEN_COMPACT_MAX_TOTAL - 1];
+        uint32_t above = 0;
+        for (uint32_t i = 0; i < selection->size; i++) {
+            above += selection->counts[i] > cutoff;
+        }
+        uint32_t ties_left = FROZEN_COMPACT_MAX_TOTAL - above;
+        uint32_t kept = 0;
+        total = 0;
+        for (uint32_t i = 0; i < selection->size; i++) {
+            uint32_t count = selection->counts[i];
+            if (count > cutoff || (count == cutoff && ties_left-- > 0)) {
+                selection->positions[kept] = selection->positions[i];
+                selection->counts[kept++] = count;
+                total += count;
+            }
+        }
+        selection->size = kept;
+    }
+
+    // Scale so that the total fits, leaving every edge at least 1
+    if (total > FROZEN_COMPACT_MAX_TOTAL) {
+        uint64_t budget = FROZEN_COMPACT_MAX_TOTAL - selection->size;
+        uint64_t scaled_total = 0;
+        for (uint32_t i = 0; i < selection->size; i++) {
+            selection->counts[i] = 1 + (uint32_t)(selection->counts[i] *
+                                                  budget / total);
+            scaled_total += selection->counts[i];
+        }
+        total = scaled_total;
+        selection->quantized = true;
+    }
+    selection->total = total;
+}
+
+/**
+ * Total variation distance between a node's full distribution and the
+ * selected one
+ */
+static double node_distance(const MarkovNode *node,
+                            const EdgeSelection *selection) {
+    if (selection->size == 0) {
+        return 1.0;
+    }
+    uint64_t kept_count = 0;
+    double difference = 0;
+    for (uint32_t i = 0; i < selection->size; i++) {
+        int count = node->frequency_list[selection->positions[i]].frequency;
+        double p = (double)count / node->total_frequency;
+        double q = (double)selection->counts[i] / (double)selection->total;
+        kept_count += (uint32_t)count;
+        difference += p > q ? p - q : q - p;
+    }
+    // Dropped edges had probability p and now 0
+    double dropped_mass = (double)((uint64_t)node->total_frequency -
+                                   kept_count) / node->total_frequency;
+    return 0.5 * (difference + dropped_mass);
+}
+
+/**
+ * Number the kept words, size the chain, then fill it
+ */
+FrozenChain* new_compact_frozen_chain(MarkovChain *markov_chain,
+                                      uint32_t min_count,
+                                      CompactReport *report) {
+    if (!markov_chain || !markov_chain->database) {
+        return NULL;
+    }
+
+    uint32_t num_nodes = (uint32_t)markov_chain->database->size;
+    uint32_t max_degree = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        if ((uint32_t)node->frequency_list_size > max_degree) {
+            max_degree = node->frequency_list_size;
+        }
+    }
+
+    FrozenChain *frozen_chain = malloc(sizeof(FrozenChain));
+    uint32_t *new_ids = malloc(((size_t)num_nodes + 1) * sizeof(uint32_t));
+    uint8_t *dead_ends = calloc((size_t)num_nodes + 1, sizeof(uint8_t));
+    EdgeSelection selection;
+    selection.positions = malloc(((size_t)max_degree + 1) * sizeof(uint32_t));
+    selection.counts = malloc(((size_t)max_degree + 1) * sizeof(uint32_t));
+    selection.sorted = malloc(((size_t)max_degree + 1) * sizeof(uint32_t));
+    uint32_t *threshold = malloc(((size_t)max_degree + 1) * sizeof(uint32_t));
+    uint32_t *alias = malloc(((size_t)max_degree + 1) * sizeof(uint32_t));
+    uint64_t *scaled_scratch = malloc(((size_t)max_degree + 1) *
+                                      sizeof(uint64_t));
+    uint32_t *index_scratch = malloc(((size_t)max_degree + 1) *
+                                     sizeof(uint32_t));
+    void *storage = NULL;
+    if (!frozen_chain || !new_ids || !dead_ends || !selection.positions ||
+        !selection.counts || !selection.sorted || !threshold || !alias ||
+        !scaled_scratch || !index_scratch) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        goto failure;
+    }
+
+    // Words seen often enough, counting the final word of the text too
+    uint32_t kept_nodes = 0;
+    uint64_t full_edges = 0;
+    uint64_t full_words_size = 0;
+    uint64_t words_size = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        uint64_t occurrences = (uint64_t)node->total_frequency +
+                               (node == markov_chain->tail);
+        size_t length = strlen(node->data) + 1;
+        full_edges += node->frequency_list_size;
+        full_words_size += length;
+        if (occurrences >= min_count) {
+            new_ids[node->id] = kept_nodes++;
+            words_size += length;
+        } else {
+            new_ids[node->id] = FROZEN_NO_NODE;
+        }
+    }
+
+    // Kept edges, and how far every node's distribution moves
+    uint64_t num_edges = 0;
+    uint32_t quantized_nodes = 0;
+    double weighted_distance = 0;
+    double max_distance = 0;
+    uint64_t total_weight = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        if (node->total_frequency == 0) {
+            continue;
+        }
+        double distance = 1.0;
+        if (new_ids[node->id] != FROZEN_NO_NODE) {
+            select_edges(node, new_ids, min_count, &selection);
+            num_edges += selection.size;
+            quantized_nodes += selection.quantized;
+            distance = node_distance(node, &selection);
+            // Tweets reaching a word that lost all its successors end there
+            dead_ends[node->id] = selection.size == 0;
+        }
+        weighted_distance += distance * node->total_frequency;
+        total_weight += (uint64_t)node->total_frequency;
+        if (distance > max_distance) {
+            max_distance = distance;
+        }
+    }
+
+    uint32_t kept_starts = 0;
+    for (uint32_t i = 0; i < markov_chain->start_count; i++) {
+        uint32_t id = markov_chain->start_nodes[i]->id;
+        kept_starts += new_ids[id] != FROZEN_NO_NODE && !dead_ends[id];
+    }
+
+    frozen_chain->num_nodes = kept_nodes;
+    frozen_chain->num_edges = (uint32_t)num_edges;
+    frozen_chain->num_starts = kept_starts;
+    frozen_chain->words_size = words_size;
+    frozen_chain->tail = markov_chain->tail ?
+                         new_ids[markov_chain->tail->id] : FROZEN_NO_NODE;
+    frozen_chain->compact = true;
+    frozen_chain->mapping = NULL;
+    frozen_chain->mapping_size = 0;
+    size_t storage_size = frozen_chain_storage_size(kept_nodes,
+                                                    frozen_chain->num_edges,
+                                                    kept_starts, words_size,
+                                                    true);
+    storage = malloc(storage_size);
+    if (!storage) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        goto failure;
+    }
+    frozen_chain_attach(frozen_chain, storage);
+
+    // The arrays are read-only once built, fill them through these
+    uint32_t *offsets = (uint32_t *)frozen_chain->offsets;
+    uint32_t *totals = (uint32_t *)frozen_chain->totals;
+    uint32_t *word_offsets = (uint32_t *)frozen_chain->word_offsets;
+    uint8_t *is_last = (uint8_t *)frozen_chain->is_last;
+    uint32_t *successors = (uint32_t *)frozen_chain->successors;
+    uint16_t *counts = (uint16_t *)frozen_chain->counts16;
+    uint16_t *alias_threshold = (uint16_t *)frozen_chain->alias_threshold16;
+    uint16_t *alias_index = (uint16_t *)frozen_chain->alias_index16;
+    uint32_t *start_ids = (uint32_t *)frozen_chain->start_ids;
+    char *words = (char *)frozen_chain->words;
+
+    uint32_t edge = 0;
+    uint32_t word_offset = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        uint32_t id = new_ids[node->id];
+        if (id == FROZEN_NO_NODE) {
+            continue;
+        }
+
+        size_t length = strlen(node->data) + 1;
+        memcpy(words + word_offset, node->data, length);
+        word_offsets[id] = word_offset;
+        word_offset += length;
+        is_last[id] = node->is_last || dead_ends[node->id];
+        offsets[id] = edge;
+
+        select_edges(node, new_ids, min_count, &selection);
+        totals[id] = (uint32_t)selection.total;
+        build_alias_table(selection.counts, selection.size, threshold, alias,
+                          scaled_scratch, index_scratch);
+        for (uint32_t i = 0; i < selection.size; i++) {
+            MarkovNode *next =
+                node->frequency_list[selection.positions[i]].markov_node;
+            successors[edge + i] = new_ids[next->id];
+            counts[edge + i] = (uint16_t)selection.counts[i];
+            alias_threshold[edge + i] = (uint16_t)threshold[i];
+            alias_index[edge + i] = (uint16_t)alias[i];
+        }
+        edge += selection.size;
+    }
+    offsets[kept_nodes] = edge;
+
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < markov_chain->start_count; i++) {
+        uint32_t id = markov_chain->start_nodes[i]->id;
+        if (new_ids[id] != FROZEN_NO_NODE && !dead_ends[id]) {
+            start_ids[start++] = new_ids[id];
+        }
+    }
+
+    if (report) {
+        report->full_bytes = frozen_chain_storage_size(
+            num_nodes, (uint32_t)full_edges, markov_chain->start_count,
+            full_words_size, false);
+        report->compact_bytes = storage_size;
+        report->pruned_words = num_nodes - kept_nodes;
+        report->pruned_edges = (uint32_t)(full_edges - num_edges);
+        report->quantized_nodes = quantized_nodes;
+        report->mean_distance = total_weight ?
+                                weighted_distance / (double)total_weight : 0;
+        report->max_distance = max_distance;
+        // Uniform over a subset of the starts
+        report->start_distance = markov_chain->start_count ?
+                                 1.0 - (double)kept_starts /
+                                       markov_chain->start_count : 0;
+    }
+
+    free(new_ids);
+    free(dead_ends);
+    free(selection.positions);
+    free(selection.counts);
+    free(selection.sorted);
+    free(threshold);
+    free(alias);
+    free(scaled_scratch);
+    free(index_scratch);
+    return frozen_chain;
+
+failure:
+    free(storage);
+    free(frozen_chain);
+    free(new_ids);
+    free(dead_ends);
+    free(selection.positions);
+    free(selection.counts);
+    free(selection.sorted);
+    free(threshold);
+    free(alias);
+    free(scaled_scratch);
+    free(index_scratch);
+    return NULL;
+}
+
+/**
+ * Memory first, then the distances
+ */
+void print_compact_report(const CompactReport *report, FILE *out) {
+    double saved = report->full_bytes ?
+                   100.0 * (1.0 - (double)report->compact_bytes /
+                                  (double)report->full_bytes) : 0;
+    fprintf(out, "Compact model: %llu bytes instead of %llu (%.1f%% saved)\n",
+            (unsigned long long)report->compact_bytes,
+            (unsigned long long)report->full_bytes, saved);
+    fprintf(out, "Pruned %u words and %u edges, scaled the counts of %u "
+            "words\n", report->pruned_words, report->pruned_edges,
+            report->quantized_nodes);
+    fprintf(out, "Total variation distance: next word %.6f on average, "
+            "%.6f at most, first word %.6f\n", report->mean_distance,
+            report->max_distance, report->start_distance);
+}
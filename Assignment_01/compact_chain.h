@@ -0,0 +1,53 @@
+#ifndef _COMPACT_CHAIN_H_
+#define _COMPACT_CHAIN_H_
+
+#include "frozen_chain.h"
+
+/**
+ * What compacting a chain cost, in memory saved and in how far the
+ * sampling distributions moved. Distances are total variation distances,
+ * 0 for the same distribution and 1 for disjoint ones.
+ */
+typedef struct CompactReport {
+    uint64_t full_bytes;      // storage of the regular frozen chain
+    uint64_t compact_bytes;   // storage of the compact one
+    uint32_t pruned_words;
+    uint32_t pruned_edges;    // including the edges of pruned words
+    uint32_t quantized_nodes; // nodes whose counts were scaled down
+    double mean_distance;     // next word distributions, weighted by count
+    double max_distance;
+    double start_distance;    // first word distribution
+} CompactReport;
+
+/**
+ * Freeze a trained chain into a compact FrozenChain: counts and alias
+ * tables are stored on 16 bits (10 instead of 16 bytes per edge).
+ *
+ * Words seen less than min_count times are dropped, with their edges and
+ * the edges leading to them, as are edges seen less than min_count times.
+ * Surviving words get new dense ids. A node whose counts add up to more
+ * than FROZEN_COMPACT_MAX_TOTAL has them scaled down proportionally (each
+ * kept edge keeps a count of at least 1), and if it has more successors
+ * than that only the most frequent ones are kept. A kept word left
+ * without successors becomes a sentence ending, so walks never get stuck.
+ *
+ * Unlike freeze_markov_chain() the result is independent of the chain,
+ * which can be freed; use it like a loaded snapshot.
+ * @param markov_chain the chain to compact
+ * @param min_count minimal number of occurrences of kept words and edges,
+ * 0 or 1 to keep everything
+ * @param report if not NULL, filled with the memory saved and distances
+ * @return the compact frozen chain, NULL in case of allocation failure.
+ */
+FrozenChain* new_compact_frozen_chain(MarkovChain *markov_chain,
+                                      uint32_t min_count,
+                                      CompactReport *report);
+
+/**
+ * Print a report as a few human readable lines.
+ * @param report the report
+ * @param out stream to print to
+ */
+void print_compact_report(const CompactReport *report, FILE *out);
+
+#endif /* _COMPACT_CHAIN_H_ */
@@ -0,0 +1,502 @@
+#include "frozen_chain.h"
+#include "markov_stats.h"
+#include <sys/mman.h> // For munmap()
+
+// Every section starts on an 8 byte boundary
+#define SECTION_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+// Hint that an address will be read soon, no-op where unsupported
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+/**
+ * Size of the block, sections in the order frozen_chain_attach() uses
+ */
+size_t frozen_chain_storage_size(uint32_t num_nodes, uint32_t num_edges,
+                                 uint32_t num_starts, uint64_t words_size,
+                                 bool compact) {
+    uint64_t size = 0;
+    size += SECTION_ALIGN(((uint64_t)num_nodes + 1) * sizeof(uint32_t));
+    size += SECTION_ALIGN((uint64_t)num_nodes * sizeof(uint32_t));
+    size += SECTION_ALIGN((uint64_t)num_nodes * sizeof(uint32_t));
+    size += SECTION_ALIGN((uint64_t)num_nodes * sizeof(uint8_t));
+    size += SECTION_ALIGN((uint64_t)num_edges * sizeof(uint32_t));
+    size += 3 * SECTION_ALIGN((uint64_t)num_edges *
+                              (compact ? sizeof(uint16_t) : sizeof(uint32_t)));
+    size += SECTION_ALIGN((uint64_t)num_starts * sizeof(uint32_t));
+    // The counts are 32-bit so the sum so far can't overflow, but words_size
+    // (read from a snapshot header) can make the total wrap around
+    if (words_size > (uint64_t)SIZE_MAX - 7 - size) {
+        return SIZE_MAX;
+    }
+    size += SECTION_ALIGN(words_size);
+    return (size_t)size;
+}
+
+/**
+ * Point every array into the block
+ */
+void frozen_chain_attach(FrozenChain *frozen_chain, void *storage) {
+    uint64_t n = frozen_chain->num_nodes;
+    uint64_t e = frozen_chain->num_edges;
+    char *next = storage;
+
+    frozen_chain->offsets = (const uint32_t *)next;
+    next += SECTION_ALIGN((n + 1) * sizeof(uint32_t));
+    frozen_chain->totals = (const uint32_t *)next;
+    next += SECTION_ALIGN(n * sizeof(uint32_t));
+    frozen_chain->word_offsets = (const uint32_t *)next;
+    next += SECTION_ALIGN(n * sizeof(uint32_t));
+    frozen_chain->is_last = (const uint8_t *)next;
+    next += SECTION_ALIGN(n * sizeof(uint8_t));
+    frozen_chain->successors = (const uint32_t *)next;
+    next += SECTION_ALIGN(e * sizeof(uint32_t));
+    if (frozen_chain->compact) {
+        frozen_chain->counts = NULL;
+        frozen_chain->alias_threshold = NULL;
+        frozen_chain->alias_index = NULL;
+        frozen_chain->counts16 = (const uint16_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint16_t));
+        frozen_chain->alias_threshold16 = (const uint16_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint16_t));
+        frozen_chain->alias_index16 = (const uint16_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint16_t));
+    } else {
+        frozen_chain->counts = (const uint32_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint32_t));
+        frozen_chain->alias_threshold = (const uint32_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint32_t));
+        frozen_chain->alias_index = (const uint32_t *)next;
+        next += SECTION_ALIGN(e * sizeof(uint32_t));
+        frozen_chain->counts16 = NULL;
+        frozen_chain->alias_threshold16 = NULL;
+        frozen_chain->alias_index16 = NULL;
+    }
+    frozen_chain->start_ids = (const uint32_t *)next;
+    next += SECTION_ALIGN((uint64_t)frozen_chain->num_starts * sizeof(uint32_t));
+    frozen_chain->words = next;
+    frozen_chain->storage = storage;
+}
+
+/**
+ * Compact the chain into CSR form
+ */
+FrozenChain* new_frozen_chain(MarkovChain *markov_chain) {
+    if (!markov_chain || !markov_chain->database) {
+        return NULL;
+    }
+
+    FrozenChain *frozen_chain = malloc(sizeof(FrozenChain));
+    if (!frozen_chain) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+
+    uint64_t num_edges = 0;
+    uint64_t words_size = 0;
+    uint32_t max_degree = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        num_edges += node->frequency_list_size;
+        words_size += strlen(node->data) + 1;
+        if ((uint32_t)node->frequency_list_size > max_degree) {
+            max_degree = node->frequency_list_size;
+        }
+    }
+    frozen_chain->num_nodes = (uint32_t)markov_chain->database->size;
+    frozen_chain->num_edges = (uint32_t)num_edges;
+    frozen_chain->num_starts = markov_chain->start_count;
+    frozen_chain->tail = markov_chain->tail ? markov_chain->tail->id :
+                         FROZEN_NO_NODE;
+    frozen_chain->compact = false;
+    frozen_chain->words_size = words_size;
+    frozen_chain->mapping = NULL;
+    frozen_chain->mapping_size = 0;
+
+    void *storage = malloc(frozen_chain_storage_size(frozen_chain->num_nodes,
+                                                     frozen_chain->num_edges,
+                                                     frozen_chain->num_starts,
+                                                     words_size, false));
+    // One extra entry, so that an empty chain never does malloc(0)
+    uint64_t *scaled_scratch = malloc((max_degree + 1) * sizeof(uint64_t));
+    uint32_t *index_scratch = malloc((max_degree + 1) * sizeof(uint32_t));
+    if (!storage || !scaled_scratch || !index_scratch) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(storage);
+        free(scaled_scratch);
+        free(index_scratch);
+        free(frozen_chain);
+        return NULL;
+    }
+    frozen_chain_attach(frozen_chain, storage);
+
+    // The arrays are read-only once built, fill them through these
+    uint32_t *offsets = (uint32_t *)frozen_chain->offsets;
+    uint32_t *totals = (uint32_t *)frozen_chain->totals;
+    uint32_t *word_offsets = (uint32_t *)frozen_chain->word_offsets;
+    uint8_t *is_last = (uint8_t *)frozen_chain->is_last;
+    uint32_t *successors = (uint32_t *)frozen_chain->successors;
+    uint32_t *counts = (uint32_t *)frozen_chain->counts;
+    uint32_t *alias_threshold = (uint32_t *)frozen_chain->alias_threshold;
+    uint32_t *alias_index = (uint32_t *)frozen_chain->alias_index;
+    char *words = (char *)frozen_chain->words;
+
+    uint32_t edge = 0;
+    uint32_t word_offset = 0;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        uint32_t id = node->id;
+        uint32_t size = (uint32_t)node->frequency_list_size;
+
+        offsets[id] = edge;
+        totals[id] = (uint32_t)node->total_frequency;
+        is_last[id] = node->is_last;
+        word_offsets[id] = word_offset;
+        size_t length = strlen(node->data) + 1;
+        memcpy(words + word_offset, node->data, length);
+        word_offset += length;
+
+        for (uint32_t i = 0; i < size; i++) {
+            successors[edge + i] = node->frequency_list[i].markov_node->id;
+            counts[edge + i] = (uint32_t)node->frequency_list[i].frequency;
+        }
+        build_alias_table(counts + edge, size, alias_threshold + edge,
+                          alias_index + edge, scaled_scratch, index_scratch);
+        edge += size;
+    }
+    offsets[frozen_chain->num_nodes] = edge;
+
+    uint32_t *start_ids = (uint32_t *)frozen_chain->start_ids;
+    for (uint32_t i = 0; i < frozen_chain->num_starts; i++) {
+        start_ids[i] = markov_chain->start_nodes[i]->id;
+    }
+
+    free(scaled_scratch);
+    free(index_scratch);
+    return frozen_chain;
+}
+
+/**
+ * Add the words in id order, then the edges of every node in CSR order
+ */
+MarkovChain* thaw_frozen_chain(const FrozenChain *frozen_chain) {
+    if (!frozen_chain) {
+        return NULL;
+    }
+
+    MarkovChain *markov_chain = new_markov_chain();
+    MarkovNode **nodes = malloc(((size_t)frozen_chain->num_nodes + 1) *
+                                sizeof(MarkovNode*));
+    if (!markov_chain || !nodes) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free_database(&markov_chain);
+        free(nodes);
+        return NULL;
+    }
+
+    for (uint32_t id = 0; id < frozen_chain->num_nodes; id++) {
+        const char *word = frozen_chain_word(frozen_chain, id);
+        Node *node = add_word_to_database(markov_chain, word, strlen(word));
+        if (!node) {
+            free_database(&markov_chain);
+            free(nodes);
+            return NULL;
+        }
+        nodes[id] = (MarkovNode*)node->data;
+    }
+
+    for (uint32_t id = 0; id < frozen_chain->num_nodes; id++) {
+        for (uint32_t edge = frozen_chain->offsets[id];
+             edge < frozen_chain->offsets[id + 1]; edge++) {
+            if (add_weighted_node_to_frequencies_list(
+                    nodes[id], nodes[frozen_chain->successors[edge]],
+                    (int)frozen_chain_count(frozen_chain, edge)) != 0) {
+                free_database(&markov_chain);
+                free(nodes);
+                return NULL;
+            }
+        }
+    }
+
+    if (frozen_chain->tail < frozen_chain->num_nodes) {
+        markov_chain->tail = nodes[frozen_chain->tail];
+    }
+    free(nodes);
+    return markov_chain;
+}
+
+/**
+ * Free or unmap the block, then free the chain
+ */
+void free_frozen_chain(FrozenChain **ptr_frozen_chain) {
+    if (!ptr_frozen_chain || !(*ptr_frozen_chain)) {
+        return;
+    }
+    FrozenChain *frozen_chain = *ptr_frozen_chain;
+    if (frozen_chain->mapping) {
+        munmap(frozen_chain->mapping, frozen_chain->mapping_size);
+    } else {
+        free(frozen_chain->storage);
+    }
+    free(frozen_chain);
+    *ptr_frozen_chain = NULL;
+}
+
+/**
+ * Draw from the given stream, or from rand() when there is none
+ */
+static inline uint32_t random_below(Rng *rng, uint32_t bound) {
+    return rng ? rng_below(rng, bound) : (uint32_t)get_random_number((int)bound);
+}
+
+/**
+ * One draw among the precomputed start candidates
+ */
+uint32_t frozen_chain_random_first(const FrozenChain *frozen_chain, Rng *rng) {
+    if (!frozen_chain || frozen_chain->num_starts == 0) {
+        return FROZEN_NO_NODE;
+    }
+    return frozen_chain->start_ids[random_below(rng, frozen_chain->num_starts)];
+}
+
+/**
+ * Sample the next node through the node's alias table
+ */
+uint32_t frozen_chain_next(const FrozenChain *frozen_chain, uint32_t id,
+                           Rng *rng) {
+    uint32_t first_edge = frozen_chain->offsets[id];
+    uint32_t degree = frozen_chain->offsets[id + 1] - first_edge;
+    if (degree == 0) {
+        return FROZEN_NO_NODE;
+    }
+
+    uint32_t column = random_below(rng, degree);
+    uint32_t coin = random_below(rng, frozen_chain->totals[id]);
+    uint32_t i;
+    if (frozen_chain->compact) {
+        i = coin < frozen_chain->alias_threshold16[first_edge + column] ?
+            column : frozen_chain->alias_index16[first_edge + column];
+    } else {
+        i = sample_alias_table(frozen_chain->alias_threshold + first_edge,
+                               frozen_chain->alias_index + first_edge,
+                               column, coin);
+    }
+    markov_stats_count_sample(1);
+    return frozen_chain->successors[first_edge + i];
+}
+
+/**
+ * Append the words of a finished tweet
+ */
+static int append_tweet(const FrozenChain *frozen_chain, const uint32_t *ids,
+                        int words, OutputBuffer *out) {
+    for (int i = 0; i < words; i++) {
+        const char *word = frozen_chain_word(frozen_chain, ids[i]);
+        if ((i > 0 && output_buffer_append_char(out, ' ') != 0) ||
+            output_buffer_append(out, word, strlen(word)) != 0) {
+            return 1;
+        }
+    }
+    return output_buffer_append_char(out, '\n');
+}
+
+/**
+ * Walk node ids from first_id, appending the tweet once it is complete
+ */
+static int frozen_walk_tweet(const FrozenChain *frozen_chain,
+                             uint32_t first_id, Rng *rng, OutputBuffer *out,
+                             TweetSpan *span) {
+    // Words are only appended once the tweet is known to be valid
+    uint32_t ids[MAX_TWEET_LENGTH];
+    int words = 0;
+    ids[words++] = first_id;
+
+    while (words < MAX_TWEET_LENGTH) {
+        uint32_t next = frozen_chain_next(frozen_chain, ids[words - 1], rng);
+        if (next == FROZEN_NO_NODE) {
+#ifdef DEBUG
+            printf("No next word found after '%s'\n",
+                   frozen_chain_word(frozen_chain, ids[words - 1]));
+#endif
+            break;
+        }
+        ids[words++] = next;
+
+        // End of sentence or maximal length
+        if (frozen_chain->is_last[next] || words >= MAX_TWEET_LENGTH) {
+            size_t start = out->length;
+            if (append_tweet(frozen_chain, ids, words, out) != 0) {
+                printf(ALLOCATION_ERROR_MASSAGE);
+                output_buffer_truncate(out, start);
+                return -1;
+            }
+            if (span) {
+                *span = (TweetSpan) {start, out->length - start};
+            }
+            return words;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Generate a random tweet, walking node ids instead of pointers
+ */
+int frozen_generate_tweet(const FrozenChain *frozen_chain, uint32_t first_id,
+                          Rng *rng, OutputBuffer *out, TweetSpan *span) {
+    if (!frozen_chain || !out || first_id >= frozen_chain->num_nodes) {
+        return -1;
+    }
+
+    uint64_t start = markov_stats_enabled ? markov_stats_now() : 0;
+    int words = frozen_walk_tweet(frozen_chain, first_id, rng, out, span);
+    markov_stats_add_time(STATS_GENERATE, start);
+    return words;
+}
+
+/**
+ * Three passes over the walks, each prefetching what the next one reads
+ */
+void frozen_chain_next_batch(const FrozenChain *frozen_chain,
+                             const uint32_t *lanes, uint32_t count,
+                             const uint32_t *ids, Rng *rngs, uint32_t *next) {
+    uint32_t edge[FROZEN_WALK_BATCH];
+    uint32_t column[FROZEN_WALK_BATCH];
+    uint32_t coin[FROZEN_WALK_BATCH];
+    bool compact = frozen_chain->compact;
+
+    for (uint32_t chunk = 0; chunk < count; chunk += FROZEN_WALK_BATCH) {
+        uint32_t size = count - chunk < FROZEN_WALK_BATCH ?
+                        count - chunk : FROZEN_WALK_BATCH;
+        const uint32_t *chunk_lanes = lanes + chunk;
+        uint32_t sampled = 0;
+
+        // Draw a column and a coin per walk, prefetch the column's entry
+        for (uint32_t k = 0; k < size; k++) {
+            uint32_t lane = chunk_lanes[k];
+            uint32_t id = ids[lane];
+            uint32_t first_edge = frozen_chain->offsets[id];
+            uint32_t degree = frozen_chain->offsets[id + 1] - first_edge;
+            if (degree == 0) {
+                next[lane] = FROZEN_NO_NODE;
+                column[k] = FROZEN_NO_NODE;
+                continue;
+            }
+            column[k] = rng_below(&rngs[lane], degree);
+            coin[k] = rng_below(&rngs[lane], frozen_chain->totals[id]);
+            edge[k] = first_edge;
+            if (compact) {
+                PREFETCH(&frozen_chain->alias_threshold16[first_edge +
+                                                          column[k]]);
+                PREFETCH(&frozen_chain->alias_index16[first_edge + column[k]]);
+            } else {
+                PREFETCH(&frozen_chain->alias_threshold[first_edge +
+                                                        column[k]]);
+                PREFETCH(&frozen_chain->alias_index[first_edge + column[k]]);
+            }
+            sampled++;
+        }
+
+        // Resolve the alias tables, prefetch the chosen successors
+        for (uint32_t k = 0; k < size; k++) {
+            if (column[k] == FROZEN_NO_NODE) {
+                continue;
+            }
+            uint32_t entry = edge[k] + column[k];
+            uint32_t i;
+            if (compact) {
+                i = coin[k] < frozen_chain->alias_threshold16[entry] ?
+                    column[k] : frozen_chain->alias_index16[entry];
+            } else {
+                i = coin[k] < frozen_chain->alias_threshold[entry] ?
+                    column[k] : frozen_chain->alias_index[entry];
+            }
+            edge[k] += i;
+            PREFETCH(&frozen_chain->successors[edge[k]]);
+        }
+
+        // Read the successors, prefetch the rows of the next step
+        for (uint32_t k = 0; k < size; k++) {
+            if (column[k] == FROZEN_NO_NODE) {
+                continue;
+            }
+            uint32_t id = frozen_chain->successors[edge[k]];
+            next[chunk_lanes[k]] = id;
+            PREFETCH(&frozen_chain->offsets[id]);
+            PREFETCH(&frozen_chain->totals[id]);
+            PREFETCH(&frozen_chain->is_last[id]);
+        }
+        markov_stats_count_samples(sampled, sampled);
+    }
+}
+
+/**
+ * Step every unfinished walk together until all of them ended
+ */
+void frozen_run_walks(const FrozenChain *frozen_chain, FrozenWalkBatch *batch) {
+    uint64_t start = markov_stats_enabled ? markov_stats_now() : 0;
+    uint32_t lanes[FROZEN_WALK_BATCH];
+    uint32_t current[FROZEN_WALK_BATCH];
+    uint32_t next[FROZEN_WALK_BATCH];
+    uint32_t active = 0;
+    for (uint32_t k = 0; k < batch->count; k++) {
+        if (batch->words[k] > 0) {
+            current[k] = batch->ids[k][batch->words[k] - 1];
+            lanes[active++] = k;
+        }
+    }
+
+    while (active > 0) {
+        frozen_chain_next_batch(frozen_chain, lanes, active, current,
+                                batch->rngs, next);
+
+        // Finished walks leave the lanes, the others keep their order
+        uint32_t still_active = 0;
+        for (uint32_t a = 0; a < active; a++) {
+            uint32_t k = lanes[a];
+            if (next[k] == FROZEN_NO_NODE) {
+                batch->words[k] = -1;
+                continue;
+            }
+            batch->ids[k][batch->words[k]++] = next[k];
+            current[k] = next[k];
+            if (!frozen_chain->is_last[next[k]] &&
+                batch->words[k] < MAX_TWEET_LENGTH) {
+                lanes[still_active++] = k;
+            }
+        }
+        active = still_active;
+    }
+    markov_stats_add_time(STATS_GENERATE, start);
+}
+
+/**
+ * Append one walk, like frozen_generate_tweet() does once it ends
+ */
+int frozen_append_walk(const FrozenChain *frozen_chain,
+                       const FrozenWalkBatch *batch, uint32_t k,
+                       OutputBuffer *out, TweetSpan *span) {
+    if (!frozen_chain || !batch || !out || k >= batch->count) {
+        return -1;
+    }
+    if (batch->words[k] <= 0) {
+        return batch->words[k];
+    }
+
+    size_t start = out->length;
+    if (append_tweet(frozen_chain, batch->ids[k], batch->words[k], out) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        output_buffer_truncate(out, start);
+        return -1;
+    }
+    if (span) {
+        *span = (TweetSpan) {start, out->length - start};
+    }
+    return batch->words[k];
+}
@@ -0,0 +1,206 @@
+#ifndef _FROZEN_CHAIN_H_
+#define _FROZEN_CHAIN_H_
+
+#include "markov_chain.h"
+#include "rng.h"
+#include <stdint.h> // For uint32_t
+
+#define FROZEN_NO_NODE UINT32_MAX
+#define FROZEN_COMPACT_MAX_TOTAL UINT16_MAX
+#define FROZEN_WALK_BATCH 16
+
+/**
+ * Read-only compressed sparse row (CSR) form of a trained MarkovChain.
+ * Nodes are numbered by their position in the database (MarkovNode::id),
+ * the successors of node i are the edges [offsets[i], offsets[i + 1]) in
+ * the order of its frequency_list. All arrays live in a single block.
+ *
+ * A compact chain (see compact_chain.h) stores counts and alias tables on
+ * 16 bits: counts, alias_threshold and alias_index are NULL and the
+ * *16 arrays are used instead. Every node total then fits in
+ * FROZEN_COMPACT_MAX_TOTAL, and so does every degree.
+ */
+typedef struct FrozenChain {
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t num_starts;             // nodes that may start a tweet
+    uint32_t tail;                   // last word trained on, or FROZEN_NO_NODE
+    bool compact;                    // 16-bit counts and alias tables
+    uint64_t words_size;             // bytes in words, NULs included
+    const uint32_t *offsets;         // num_nodes + 1 edge offsets
+    const uint32_t *totals;          // num_nodes sums of counts
+    const uint32_t *word_offsets;    // num_nodes offsets into words
+    const uint8_t *is_last;          // num_nodes sentence end flags
+    const uint32_t *successors;      // num_edges node ids
+    const uint32_t *counts;          // num_edges occurrence counts
+    const uint32_t *alias_threshold; // num_edges, see alias_table.h
+    const uint32_t *alias_index;     // num_edges, relative to the node
+    const uint16_t *counts16;        // the same three, compact chains only
+    const uint16_t *alias_threshold16;
+    const uint16_t *alias_index16;
+    const uint32_t *start_ids;       // num_starts non sentence ending ids
+    const char *words;               // NUL terminated words back to back
+    void *storage;                   // the block all arrays point into
+    void *mapping;                   // mapped snapshot file, or NULL
+    size_t mapping_size;
+} FrozenChain;
+
+/**
+ * Tweets generated together, their walks interleaved step by step. Set
+ * count, then for every walk k seed rngs[k] and either set ids[k][0] to
+ * the first word and words[k] to 1, or words[k] to 0 to skip it.
+ * frozen_run_walks() leaves in words[k] the length of the tweet, or -1 if
+ * the walk got stuck.
+ */
+typedef struct FrozenWalkBatch {
+    uint32_t count;                                 // at most FROZEN_WALK_BATCH
+    Rng rngs[FROZEN_WALK_BATCH];
+    uint32_t ids[FROZEN_WALK_BATCH][MAX_TWEET_LENGTH];
+    int words[FROZEN_WALK_BATCH];
+} FrozenWalkBatch;
+
+/**
+ * Number of bytes needed to store a frozen chain of the given size.
+ * @param num_nodes number of nodes
+ * @param num_edges number of edges
+ * @param num_starts number of nodes that may start a tweet
+ * @param words_size bytes of all words, NULs included
+ * @param compact true for 16-bit counts and alias tables
+ * @return size of the block, SIZE_MAX if it does not fit in a size_t
+ */
+size_t frozen_chain_storage_size(uint32_t num_nodes, uint32_t num_edges,
+                                 uint32_t num_starts, uint64_t words_size,
+                                 bool compact);
+
+/**
+ * Point the arrays of frozen_chain into a block of
+ * frozen_chain_storage_size() bytes, using its num_nodes, num_edges,
+ * num_starts, words_size and compact fields. The block must be 8 byte aligned.
+ * @param frozen_chain chain whose sizes are set
+ * @param storage block to point into
+ */
+void frozen_chain_attach(FrozenChain *frozen_chain, void *storage);
+
+/**
+ * Compact a trained chain into CSR form, with alias tables for every node.
+ * @param markov_chain the chain to compact
+ * @return the frozen chain, NULL in case of allocation failure.
+ */
+FrozenChain* new_frozen_chain(MarkovChain *markov_chain);
+
+/**
+ * Rebuild a trainable chain from a frozen one, e.g. a loaded snapshot.
+ * Nodes keep their ids and successors their order, so freezing the
+ * result gives back the same arrays. The frozen chain is not used
+ * afterwards and may be freed. The tail is kept, so text trained on the
+ * result continues the original text.
+ * @param frozen_chain the chain to thaw
+ * @return the chain, NULL in case of allocation failure.
+ */
+MarkovChain* thaw_frozen_chain(const FrozenChain *frozen_chain);
+
+/**
+ * Free a frozen chain created by new_frozen_chain() or loaded from a
+ * snapshot.
+ * @param ptr_frozen_chain frozen chain to free, set to NULL
+ */
+void free_frozen_chain(FrozenChain **ptr_frozen_chain);
+
+/**
+ * Get the word of a node.
+ * @param frozen_chain the chain
+ * @param id node id
+ * @return the NUL terminated word
+ */
+static inline const char* frozen_chain_word(const FrozenChain *frozen_chain,
+                                            uint32_t id) {
+    return frozen_chain->words + frozen_chain->word_offsets[id];
+}
+
+/**
+ * Get the occurrence count of an edge, whatever the encoding.
+ * @param frozen_chain the chain
+ * @param edge edge index
+ * @return the count
+ */
+static inline uint32_t frozen_chain_count(const FrozenChain *frozen_chain,
+                                          uint32_t edge) {
+    return frozen_chain->compact ? frozen_chain->counts16[edge] :
+                                   frozen_chain->counts[edge];
+}
+
+/**
+ * Get one random node that isn't a sentence ending, uniformly from
+ * start_ids like get_first_random_node() does.
+ * @param frozen_chain the chain
+ * @param rng random stream to draw from, NULL for get_random_number()
+ * @return the node id, FROZEN_NO_NODE if none was found
+ */
+uint32_t frozen_chain_random_first(const FrozenChain *frozen_chain, Rng *rng);
+
+/**
+ * Choose randomly the next node, depend on it's occurrence frequency.
+ * @param frozen_chain the chain
+ * @param id current node id
+ * @param rng random stream to draw from, NULL for get_random_number()
+ * @return the next node id, FROZEN_NO_NODE if the node has no successors
+ */
+uint32_t frozen_chain_next(const FrozenChain *frozen_chain, uint32_t id,
+                           Rng *rng);
+
+/**
+ * Advance several independent walks by one step each. The walks are
+ * processed in phases (draw and read the alias entry, resolve it, read the
+ * successor) over the whole batch, with the next phase's memory prefetched,
+ * so the cache misses of different walks overlap instead of adding up.
+ * Walk lane draws from rngs[lane] exactly like frozen_chain_next().
+ * @param frozen_chain the chain
+ * @param lanes the walks to advance, indexes into ids, rngs and next
+ * @param count number of lanes
+ * @param ids current node of every walk
+ * @param rngs random stream of every walk
+ * @param next set to the next node of every advanced walk, FROZEN_NO_NODE
+ * if it has no successors
+ */
+void frozen_chain_next_batch(const FrozenChain *frozen_chain,
+                             const uint32_t *lanes, uint32_t count,
+                             const uint32_t *ids, Rng *rngs, uint32_t *next);
+
+/**
+ * Run the walks of a batch to their end, with the rules of
+ * frozen_generate_tweet(): every tweet is the same as frozen_generate_tweet()
+ * would generate from the same first word and stream.
+ * @param frozen_chain the chain
+ * @param batch the walks, see FrozenWalkBatch
+ */
+void frozen_run_walks(const FrozenChain *frozen_chain, FrozenWalkBatch *batch);
+
+/**
+ * Append a finished walk of a batch as a tweet (and its newline).
+ * @param frozen_chain the chain
+ * @param batch the batch, after frozen_run_walks()
+ * @param k the walk
+ * @param out buffer to append the tweet to
+ * @param span if not NULL, set to the bytes of the tweet in out
+ * @return Number of words in tweet, 0 if the walk was skipped, -1 if it got
+ * stuck or in case of allocation failure
+ */
+int frozen_append_walk(const FrozenChain *frozen_chain,
+                       const FrozenWalkBatch *batch, uint32_t k,
+                       OutputBuffer *out, TweetSpan *span);
+
+/**
+ * Create random sentence using the frozen chain, with the same rules as
+ * generate_tweet(), and append it to an output buffer. Nothing is
+ * appended on failure.
+ * @param frozen_chain the chain
+ * @param first_id first word in chain
+ * @param rng random stream to draw from, NULL for get_random_number()
+ * @param out buffer to append the tweet (and its newline) to
+ * @param span if not NULL, set to the bytes of the tweet in out
+ * @return Number of words in tweet, -1 on failure
+ */
+int frozen_generate_tweet(const FrozenChain *frozen_chain, uint32_t first_id,
+                          Rng *rng, OutputBuffer *out, TweetSpan *span);
+
+#endif /* _FROZEN_CHAIN_H_ */
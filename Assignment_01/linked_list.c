@@ -7,6 +7,12 @@ int add(LinkedList *link_list, void *data)
     {
         return 1;
     }
+    add_node(link_list, new_node, data);
+    return 0;
+}
+
+void add_node(LinkedList *link_list, Node *new_node, void *data)
+{
     *new_node = (Node) {data, NULL};
 
     if (link_list->first == NULL)
@@ -21,5 +27,4 @@ int add(LinkedList *link_list, void *data)
     }
 
     link_list->size++;
-    return 0;
 }
\ No newline at end of file
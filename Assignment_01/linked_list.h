@@ -21,4 +21,13 @@ typedef struct LinkedList {
  */
 int add (LinkedList *link_list, void *data);
 
+/**
+ * Link an already allocated node holding data at the end of the given
+ * link list. The list does not take ownership of the node's memory.
+ * @param link_list Link list to add the node to
+ * @param new_node node to link, its fields are overwritten
+ * @param data pointer to the data the node wraps
+ */
+void add_node (LinkedList *link_list, Node *new_node, void *data);
+
 #endif //_LINKEDLIST_H_
@@ -0,0 +1,586 @@
+#include "markov_chain.h"
+#include "frozen_chain.h"
+#include "tokenizer.h"
+#include "rng.h"
+#include <math.h>         // For pow()
+#include <sys/resource.h> // For getrusage()
+#include <sys/wait.h>     // For waitpid()
+#include <time.h>         // For clock_gettime()
+#include <unistd.h>       // For fork(), pipe()
+
+#define USAGE "Usage: markov_bench <seed_corpus> [--min-words N] "\
+            "[--max-words N] [--zipf S] [--samples N] [--tweets N] "\
+            "[--seed N] [--format csv|json] [--output PATH]\n"
+#define DEFAULT_MIN_WORDS 10000L
+#define DEFAULT_MAX_WORDS 100000000L
+#define DEFAULT_ZIPF_EXPONENT 1.0
+#define DEFAULT_SAMPLES 1000000L
+#define DEFAULT_TWEETS 100000L
+#define ZIPF_SCALE (1u << 24)  // weight of the most frequent word
+#define HEAPS_K 30.0           // vocabulary = HEAPS_K * words^HEAPS_BETA
+#define HEAPS_BETA 0.6
+#define WORDS_PER_LINE 16
+
+/**
+ * What to run and where the results go
+ */
+typedef struct BenchOptions {
+    const char *seed_corpus;
+    long min_words;
+    long max_words;
+    double zipf_exponent;
+    long samples;   // draws per sampling latency measure
+    long tweets;    // tweets per generation measure
+    uint64_t seed;
+    bool json;
+    const char *output;
+} BenchOptions;
+
+/**
+ * Words of the real corpus, most frequent first
+ */
+typedef struct SeedVocabulary {
+    const char **words;
+    uint32_t size;
+    Arena arena;
+} SeedVocabulary;
+
+/**
+ * Measures of one corpus size, sent from the child back to the parent
+ */
+typedef struct BenchResult {
+    long words;
+    long corpus_bytes;
+    long vocabulary;        // distinct words in the built chain
+    long edges;
+    double build_seconds;
+    double build_words_per_second;
+    double freeze_seconds;
+    long rss_corpus_kb;     // peak RSS once the corpus was generated
+    long rss_peak_kb;       // peak RSS after building and freezing
+    double first_node_ns;
+    double next_node_ns;        // linear scan over the frequency list
+    double next_node_frozen_ns; // alias table
+    double tweets_per_second;
+    double batched_tweets_per_second; // FROZEN_WALK_BATCH walks interleaved
+    int failed;
+} BenchResult;
+
+/**
+ * Seconds on the monotonic clock
+ */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Peak resident set size of this process, in KB
+ */
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Parse the command line
+ * @return 0 on success, 1 if the command line is invalid
+ */
+static int parse_arguments(int argc, char *argv[], BenchOptions *options) {
+    *options = (BenchOptions) {NULL, DEFAULT_MIN_WORDS, DEFAULT_MAX_WORDS,
+                               DEFAULT_ZIPF_EXPONENT, DEFAULT_SAMPLES,
+                               DEFAULT_TWEETS, 1, false, NULL};
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            if (options->seed_corpus) {
+                return 1;
+            }
+            options->seed_corpus = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (strcmp(argv[i - 1], "--min-words") == 0) {
+            options->min_words = strtol(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--max-words") == 0) {
+            options->max_words = strtol(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--zipf") == 0) {
+            options->zipf_exponent = strtod(value, NULL);
+        } else if (strcmp(argv[i - 1], "--samples") == 0) {
+            options->samples = strtol(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--tweets") == 0) {
+            options->tweets = strtol(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--seed") == 0) {
+            options->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--format") == 0) {
+            if (strcmp(value, "json") != 0 && strcmp(value, "csv") != 0) {
+                return 1;
+            }
+            options->json = strcmp(value, "json") == 0;
+        } else if (strcmp(argv[i - 1], "--output") == 0) {
+            options->output = value;
+        } else {
+            return 1;
+        }
+    }
+
+    return !options->seed_corpus || options->min_words < 2 ||
+           options->max_words < options->min_words ||
+           options->zipf_exponent <= 0 || options->samples < 1 ||
+           options->tweets < 1;
+}
+
+/**
+ * A distinct word of the real corpus
+ */
+typedef struct WordCount {
+    const char *word;
+    uint32_t length;
+    uint32_t count;
+    uint32_t first;   // order of first occurrence
+} WordCount;
+
+/**
+ * Order words by decreasing count, then by first occurrence
+ */
+static int compare_word_counts(const void *a, const void *b) {
+    const WordCount *x = a;
+    const WordCount *y = b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->first < y->first ? -1 : (x->first > y->first);
+}
+
+/**
+ * Read the distinct words of the real corpus, ranked by frequency
+ * @return 0 on success, 1 in case of failure
+ */
+static int load_seed_vocabulary(const char *path, SeedVocabulary *vocabulary) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        printf("Error: incorrect file path\n");
+        return 1;
+    }
+    TextSource source;
+    int failed = open_text_source(fp, &source);
+    fclose(fp);
+    if (failed) {
+        return 1;
+    }
+
+    WordIndex index;
+    WordCount *counts = NULL;
+    uint32_t size = 0;
+    uint32_t capacity = 0;
+    if (word_index_init(&index, WORD_INDEX_INITIAL_CAPACITY) != 0) {
+        close_text_source(&source);
+        return 1;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, source.text, source.size);
+    const char *word;
+    size_t length;
+    while (!failed && next_word(&tokenizer, &word, &length)) {
+        uint32_t hash = hash_word(word, length);
+        void *value = word_index_find(&index, word, length, hash);
+        if (value) {
+            counts[(uintptr_t)value - 1].count++;
+            continue;
+        }
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            WordCount *new_counts = realloc(counts,
+                                            capacity * sizeof(WordCount));
+            if (!new_counts) {
+                failed = 1;
+                break;
+            }
+            counts = new_counts;
+        }
+        counts[size] = (WordCount) {word, (uint32_t)length, 1, size};
+        failed = word_index_insert(&index, word, length, hash,
+                                   (void *)((uintptr_t)size + 1));
+        size++;
+    }
+    word_index_destroy(&index);
+
+    // Words are copied out, the text is released right after
+    arena_init(&vocabulary->arena, ARENA_DEFAULT_BLOCK_SIZE);
+    vocabulary->words = malloc((size + 1) * sizeof(const char *));
+    vocabulary->size = size;
+    failed = failed || size == 0 || !vocabulary->words;
+    if (!failed) {
+        qsort(counts, size, sizeof(WordCount), compare_word_counts);
+        for (uint32_t i = 0; i < size && !failed; i++) {
+            vocabulary->words[i] = arena_strndup(&vocabulary->arena,
+                                                 counts[i].word,
+                                                 counts[i].length);
+            failed = !vocabulary->words[i];
+        }
+    }
+    free(counts);
+    close_text_source(&source);
+    return failed;
+}
+
+/**
+ * Word of the given Zipf rank. Ranks past the real vocabulary reuse a
+ * real word with a numbered suffix, put before a final period so that
+ * sentence endings stay as frequent.
+ */
+static char *ranked_word(const SeedVocabulary *vocabulary, uint32_t rank,
+                         Arena *arena) {
+    const char *base = vocabulary->words[rank % vocabulary->size];
+    uint32_t copy = rank / vocabulary->size;
+    size_t length = strlen(base);
+    if (copy == 0) {
+        return arena_strndup(arena, base, length);
+    }
+
+    bool is_last = base[length - 1] == '.';
+    size_t stem = is_last ? length - 1 : length;
+    char buffer[512];
+    int written = snprintf(buffer, sizeof(buffer), "%.*s_%u%s",
+                           (int)(stem > 400 ? 400 : stem), base, copy,
+                           is_last ? "." : "");
+    return arena_strndup(arena, buffer, (size_t)written);
+}
+
+/**
+ * Write a corpus of the given number of words, drawn independently from
+ * a Zipf distribution over a vocabulary sized by Heaps' law
+ * @return 0 on success, 1 in case of allocation failure
+ */
+static int generate_corpus(const SeedVocabulary *vocabulary,
+                           const BenchOptions *options, long words,
+                           OutputBuffer *corpus) {
+    double heaps = HEAPS_K * pow((double)words, HEAPS_BETA);
+    uint32_t size = heaps < (double)words ? (uint32_t)heaps : (uint32_t)words;
+
+    Arena arena;
+    arena_init(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+    char **ranked = malloc(size * sizeof(char *));
+    size_t *lengths = malloc(size * sizeof(size_t));
+    uint32_t *weights = malloc(size * sizeof(uint32_t));
+    uint32_t *threshold = malloc(size * sizeof(uint32_t));
+    uint32_t *alias = malloc(size * sizeof(uint32_t));
+    uint64_t *scaled_scratch = malloc(size * sizeof(uint64_t));
+    uint32_t *index_scratch = malloc(size * sizeof(uint32_t));
+    int failed = !ranked || !lengths || !weights || !threshold || !alias ||
+                 !scaled_scratch || !index_scratch;
+
+    uint64_t total = 0;
+    if (!failed) {
+        for (uint32_t rank = 0; rank < size && !failed; rank++) {
+            ranked[rank] = ranked_word(vocabulary, rank, &arena);
+            failed = !ranked[rank];
+            if (!failed) {
+                lengths[rank] = strlen(ranked[rank]);
+            }
+            double weight = ZIPF_SCALE / pow(rank + 1.0,
+                                             options->zipf_exponent);
+            weights[rank] = weight < 1.0 ? 1 : (uint32_t)weight;
+        }
+        total = build_alias_table(weights, size, threshold, alias,
+                                  scaled_scratch, index_scratch);
+        failed = failed || total > UINT32_MAX;
+    }
+
+    Rng rng;
+    rng_seed(&rng, options->seed, (uint64_t)words);
+    for (long i = 0; i < words && !failed; i++) {
+        uint32_t column = rng_below(&rng, size);
+        uint32_t coin = rng_below(&rng, (uint32_t)total);
+        uint32_t rank = sample_alias_table(threshold, alias, column, coin);
+        char separator = (i + 1) % WORDS_PER_LINE == 0 ? '\n' : ' ';
+        failed = output_buffer_append(corpus, ranked[rank], lengths[rank]) ||
+                 output_buffer_append_char(corpus, separator);
+    }
+
+    free(ranked);
+    free(lengths);
+    free(weights);
+    free(threshold);
+    free(alias);
+    free(scaled_scratch);
+    free(index_scratch);
+    arena_free(&arena);
+    return failed;
+}
+
+/**
+ * Average cost of get_first_random_node()
+ */
+static double measure_first_node(MarkovChain *chain, long samples) {
+    uintptr_t sink = 0;
+    double start = now_seconds();
+    for (long i = 0; i < samples; i++) {
+        sink ^= (uintptr_t)get_first_random_node(chain);
+    }
+    double elapsed = now_seconds() - start;
+    // Keep the calls from being optimized away
+    if (sink == 1) {
+        printf(" ");
+    }
+    return elapsed * 1e9 / (double)samples;
+}
+
+/**
+ * Average cost of get_next_random_node() along random walks, which start
+ * over at a random first node on sentence endings and dead ends
+ */
+static double measure_next_node(MarkovChain *chain, long samples) {
+    MarkovNode *node = get_first_random_node(chain);
+    if (!node) {
+        return 0;
+    }
+    double start = now_seconds();
+    for (long i = 0; i < samples; i++) {
+        if (node->is_last || node->frequency_list_size == 0) {
+            node = get_first_random_node(chain);
+        }
+        node = get_next_random_node(node);
+    }
+    return (now_seconds() - start) * 1e9 / (double)samples;
+}
+
+/**
+ * Tweets per second generated from the frozen chain into memory
+ */
+static double measure_tweets(MarkovChain *chain, long tweets) {
+    OutputBuffer buffer;
+    output_buffer_init(&buffer, OUTPUT_BUFFER_NO_FD, 0);
+    double start = now_seconds();
+    for (long i = 0; i < tweets; i++) {
+        MarkovNode *first = get_first_random_node(chain);
+        if (first) {
+            generate_tweet_to_buffer(first, chain, &buffer, NULL);
+        }
+        // Only the generation is measured, not the growth of the buffer
+        if (buffer.length >= OUTPUT_BUFFER_FLUSH_SIZE) {
+            output_buffer_truncate(&buffer, 0);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    output_buffer_free(&buffer);
+    return elapsed > 0 ? (double)tweets / elapsed : 0;
+}
+
+/**
+ * Tweets per second generated from the frozen chain into memory, with
+ * interleaved walks
+ */
+static double measure_batched_tweets(const FrozenChain *frozen_chain,
+                                     long tweets, uint64_t seed) {
+    OutputBuffer buffer;
+    output_buffer_init(&buffer, OUTPUT_BUFFER_NO_FD, 0);
+    FrozenWalkBatch batch;
+    double start = now_seconds();
+    for (long i = 0; i < tweets; i += FROZEN_WALK_BATCH) {
+        batch.count = tweets - i < FROZEN_WALK_BATCH ? (uint32_t)(tweets - i) :
+                      FROZEN_WALK_BATCH;
+        for (uint32_t k = 0; k < batch.count; k++) {
+            rng_seed(&batch.rngs[k], seed, (uint64_t)(i + k));
+            batch.ids[k][0] = frozen_chain_random_first(frozen_chain,
+                                                        &batch.rngs[k]);
+            batch.words[k] = batch.ids[k][0] == FROZEN_NO_NODE ? 0 : 1;
+        }
+        frozen_run_walks(frozen_chain, &batch);
+        for (uint32_t k = 0; k < batch.count; k++) {
+            frozen_append_walk(frozen_chain, &batch, k, &buffer, NULL);
+        }
+        if (buffer.length >= OUTPUT_BUFFER_FLUSH_SIZE) {
+            output_buffer_truncate(&buffer, 0);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    output_buffer_free(&buffer);
+    return elapsed > 0 ? (double)tweets / elapsed : 0;
+}
+
+/**
+ * Run every measure on one corpus size, in a fresh child process so that
+ * its peak RSS isn't hidden by a bigger run before it
+ */
+static void run_size(const SeedVocabulary *vocabulary,
+                     const BenchOptions *options, long words,
+                     BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->words = words;
+    srand((unsigned int)options->seed);
+
+    OutputBuffer corpus;
+    output_buffer_init(&corpus, OUTPUT_BUFFER_NO_FD, 0);
+    if (generate_corpus(vocabulary, options, words, &corpus) != 0) {
+        result->failed = 1;
+        output_buffer_free(&corpus);
+        return;
+    }
+    result->corpus_bytes = (long)corpus.length;
+    result->rss_corpus_kb = peak_rss_kb();
+
+    MarkovChain *chain = new_markov_chain();
+    double start = now_seconds();
+    if (!chain ||
+        train_markov_chain(chain, corpus.data, corpus.length, -1) < 0) {
+        result->failed = 1;
+        free_database(&chain);
+        output_buffer_free(&corpus);
+        return;
+    }
+    result->build_seconds = now_seconds() - start;
+    result->build_words_per_second = result->build_seconds > 0 ?
+                                     words / result->build_seconds : 0;
+    output_buffer_free(&corpus);
+
+    result->vocabulary = chain->database->size;
+    result->first_node_ns = measure_first_node(chain, options->samples);
+    result->next_node_ns = measure_next_node(chain, options->samples);
+
+    start = now_seconds();
+    if (freeze_markov_chain(chain) != 0) {
+        result->failed = 1;
+        free_database(&chain);
+        return;
+    }
+    result->freeze_seconds = now_seconds() - start;
+    result->edges = chain->frozen->num_edges;
+    result->rss_peak_kb = peak_rss_kb();
+
+    result->next_node_frozen_ns = measure_next_node(chain, options->samples);
+    result->tweets_per_second = measure_tweets(chain, options->tweets);
+    result->batched_tweets_per_second =
+        measure_batched_tweets(chain->frozen, options->tweets, options->seed);
+    free_database(&chain);
+}
+
+/**
+ * Fork, run one size in the child and read its result through a pipe
+ */
+static int run_size_in_child(const SeedVocabulary *vocabulary,
+                             const BenchOptions *options, long words,
+                             BenchResult *result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        BenchResult child_result;
+        run_size(vocabulary, options, words, &child_result);
+        ssize_t written = write(fds[1], &child_result, sizeof(child_result));
+        close(fds[1]);
+        _exit(written == (ssize_t)sizeof(child_result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t received = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return received != (ssize_t)sizeof(*result) || result->failed;
+}
+
+/**
+ * Print one result as a CSV row or a JSON object
+ */
+static void print_result(FILE *out, const BenchResult *result, bool json,
+                         bool first) {
+    if (!json) {
+        fprintf(out, "%ld,%ld,%ld,%ld,%.6f,%.0f,%.6f,%ld,%ld,%.1f,%.1f,%.1f,"
+                "%.0f,%.0f\n",
+                result->words, result->corpus_bytes, result->vocabulary,
+                result->edges, result->build_seconds,
+                result->build_words_per_second, result->freeze_seconds,
+                result->rss_corpus_kb, result->rss_peak_kb,
+                result->first_node_ns, result->next_node_ns,
+                result->next_node_frozen_ns, result->tweets_per_second,
+                result->batched_tweets_per_second);
+        return;
+    }
+    fprintf(out, "%s\n  {\"words\": %ld, \"corpus_bytes\": %ld, "
+            "\"vocabulary\": %ld, \"edges\": %ld, \"build_seconds\": %.6f, "
+            "\"build_words_per_second\": %.0f, \"freeze_seconds\": %.6f, "
+            "\"rss_corpus_kb\": %ld, \"rss_peak_kb\": %ld, "
+            "\"first_node_ns\": %.1f, \"next_node_ns\": %.1f, "
+            "\"next_node_frozen_ns\": %.1f, \"tweets_per_second\": %.0f, "
+            "\"batched_tweets_per_second\": %.0f}",
+            first ? "" : ",", result->words, result->corpus_bytes,
+            result->vocabulary, result->edges, result->build_seconds,
+            result->build_words_per_second, result->freeze_seconds,
+            result->rss_corpus_kb, result->rss_peak_kb,
+            result->first_node_ns, result->next_node_ns,
+            result->next_node_frozen_ns, result->tweets_per_second,
+            result->batched_tweets_per_second);
+}
+
+/**
+ * Main function: one run per power of ten between min and max words
+ */
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    if (parse_arguments(argc, argv, &options) != 0) {
+        printf(USAGE);
+        return EXIT_FAILURE;
+    }
+
+    SeedVocabulary vocabulary;
+    if (load_seed_vocabulary(options.seed_corpus, &vocabulary) != 0) {
+        printf("Failed to read the seed corpus.\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        printf("Error: can't write %s\n", options.output);
+        return EXIT_FAILURE;
+    }
+    if (options.json) {
+        fprintf(out, "[");
+    } else {
+        fprintf(out, "words,corpus_bytes,vocabulary,edges,build_seconds,"
+                "build_words_per_second,freeze_seconds,rss_corpus_kb,"
+                "rss_peak_kb,first_node_ns,next_node_ns,next_node_frozen_ns,"
+                "tweets_per_second,batched_tweets_per_second\n");
+    }
+
+    int failed = 0;
+    bool first = true;
+    for (long words = options.min_words; words <= options.max_words;
+         words = words > options.max_words / 10 ? options.max_words + 1 :
+                 words * 10) {
+        BenchResult result;
+        if (run_size_in_child(&vocabulary, &options, words, &result) != 0) {
+            fprintf(stderr, "Benchmark of %ld words failed.\n", words);
+            failed = 1;
+            break;
+        }
+        print_result(out, &result, options.json, first);
+        fflush(out);
+        first = false;
+    }
+
+    if (options.json) {
+        fprintf(out, "\n]\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(vocabulary.words);
+    arena_free(&vocabulary.arena);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,5 +1,8 @@
 //#define DEBUG
 #include "markov_chain.h"
+#include "frozen_chain.h"
+#include "tokenizer.h"
+#include "markov_stats.h"
 
 /**
  * Get random number between 0 and max_number [0, max_number)
@@ -10,6 +13,43 @@ int get_random_number(int max_number) {
     return rand() % max_number;;
 }
 
+/**
+ * Create a new empty chain
+ */
+MarkovChain* new_markov_chain(void) {
+    MarkovChain *chain = malloc(sizeof(MarkovChain));
+    if (!chain) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+
+    chain->database = malloc(sizeof(LinkedList));
+    if (!chain->database) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(chain);
+        return NULL;
+    }
+    chain->database->first = NULL;
+    chain->database->last = NULL;
+    chain->database->size = 0;
+    arena_init(&chain->arena, ARENA_DEFAULT_BLOCK_SIZE);
+    chain->frozen = NULL;
+    chain->frozen_stale = false;
+    chain->tail = NULL;
+    chain->start_nodes = NULL;
+    chain->start_count = 0;
+    chain->start_capacity = 0;
+
+    if (word_index_init(&chain->index, WORD_INDEX_INITIAL_CAPACITY) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(chain->database);
+        free(chain);
+        return NULL;
+    }
+
+    return chain;
+}
+
 /**
  * Check if data_ptr is in database
  */
@@ -18,14 +58,9 @@ Node* get_node_from_database(MarkovChain *markov_chain, char *data_ptr) {
         return NULL;
     }
 
-    Node *current = markov_chain->database->first;
-    while (current != NULL) {
-        if (strcmp(((MarkovNode*)current->data)->data, data_ptr) == 0) {
-            return current;
-        }
-        current = current->next;
-    }
-    return NULL;
+    size_t length = strlen(data_ptr);
+    return word_index_find(&markov_chain->index, data_ptr, length,
+                           hash_word(data_ptr, length));
 }
 
 /**
@@ -35,28 +70,55 @@ Node* add_to_database(MarkovChain *markov_chain, char *data_ptr) {
     if (!markov_chain || !data_ptr) {
         return NULL;
     }
+    return add_word_to_database(markov_chain, data_ptr, strlen(data_ptr));
+}
 
-    // Check if already exists
-    Node *existing = get_node_from_database(markov_chain, data_ptr);
-    if (existing != NULL) {
-        return existing;
+/**
+ * Remember a node that may start a tweet, doubling the array when full
+ */
+static int add_start_node(MarkovChain *markov_chain, MarkovNode *node) {
+    if (markov_chain->start_count == markov_chain->start_capacity) {
+        uint32_t capacity = markov_chain->start_capacity ?
+                            markov_chain->start_capacity * 2 : 64;
+        MarkovNode **start_nodes = realloc(markov_chain->start_nodes,
+                                           capacity * sizeof(MarkovNode*));
+        if (!start_nodes) {
+            return 1;
+        }
+        markov_chain->start_nodes = start_nodes;
+        markov_chain->start_capacity = capacity;
     }
+    markov_chain->start_nodes[markov_chain->start_count++] = node;
+    return 0;
+}
 
-    // Create new MarkovNode
-    MarkovNode *new_markov_node = malloc(sizeof(MarkovNode));
-    if (!new_markov_node) {
-        printf(ALLOCATION_ERROR_MASSAGE);
+/**
+ * Add a word given as (pointer, length) to the database if not exists
+ */
+Node* add_word_to_database(MarkovChain *markov_chain, const char *word,
+                           size_t length) {
+    if (!markov_chain || !word || length == 0) {
         return NULL;
     }
 
-    // Copy the word
-    new_markov_node->data = malloc(strlen(data_ptr) + 1);
-    if (!new_markov_node->data) {
+    // Check if already exists
+    uint32_t hash = hash_word(word, length);
+    Node *existing = word_index_find(&markov_chain->index, word, length, hash);
+    if (existing != NULL) {
+        return existing;
+    }
+
+    // Carve the MarkovNode, its list link and the word out of the arena
+    MarkovNode *new_markov_node = arena_alloc(&markov_chain->arena,
+                                              sizeof(MarkovNode));
+    Node *new_node = arena_alloc(&markov_chain->arena, sizeof(Node));
+    char *data = arena_strndup(&markov_chain->arena, word, length);
+    if (!new_markov_node || !new_node || !data) {
         printf(ALLOCATION_ERROR_MASSAGE);
-        free(new_markov_node);
         return NULL;
     }
-    strcpy(new_markov_node->data, data_ptr);
+    new_markov_node->data = data;
+    new_markov_node->id = (uint32_t)markov_chain->database->size;
 #ifdef DEBUG
     printf("Added to database: '%s', length: %lu\n", new_markov_node->data,
            strlen(new_markov_node->data));
@@ -64,51 +126,224 @@ Node* add_to_database(MarkovChain *markov_chain, char *data_ptr) {
     // Initialize other fields
     new_markov_node->frequency_list = NULL;
     new_markov_node->frequency_list_size = 0;
+    new_markov_node->frequency_list_capacity = 0;
+    new_markov_node->successor_slots = NULL;
+    new_markov_node->successor_slots_capacity = 0;
     new_markov_node->total_frequency = 0;
-    new_markov_node->is_last = (data_ptr[strlen(data_ptr)-1] == '.');
+    new_markov_node->is_last = (word[length-1] == '.');
+    new_markov_node->alias_threshold = NULL;
+    new_markov_node->alias_index = NULL;
 
-    // Add to database
-    if (add(markov_chain->database, new_markov_node) != 0) {
-        free(new_markov_node->data);
-        free(new_markov_node);
+    // Index the word, the key points at the node's own copy
+    if (word_index_insert(&markov_chain->index, data, length, hash,
+                          new_node) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+
+    // Sentence endings never start a tweet
+    if (!new_markov_node->is_last &&
+        add_start_node(markov_chain, new_markov_node) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
         return NULL;
     }
 
-    return markov_chain->database->last;
+    // Add to database
+    add_node(markov_chain->database, new_node, new_markov_node);
+    if (markov_chain->frozen) {
+        markov_chain->frozen_stale = true;
+    }
+
+    return new_node;
+}
+
+/**
+ * Stream words into the chain, linking each to the one before it
+ */
+int train_markov_chain(MarkovChain *markov_chain, const char *text,
+                       size_t size, int words_to_read) {
+    if (!markov_chain || !text) {
+        return -1;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, text, size);
+    const char *word;
+    size_t length;
+    int words_read = 0;
+    StatsTimer timer;
+    stats_timer_start(&timer);
+
+    // Read words until the end or word limit reached
+    while ((words_to_read == -1 || words_read < words_to_read) &&
+           next_word(&tokenizer, &word, &length)) {
+        stats_timer_lap(&timer, STATS_TOKENIZE);
+        Node *current = add_word_to_database(markov_chain, word, length);
+        stats_timer_lap(&timer, STATS_LOOKUP);
+        if (!current) {
+#ifdef DEBUG
+            printf("Failed to add word: %.*s\n", (int)length, word);
+#endif
+            stats_timer_stop(&timer);
+            return -1;
+        }
+        words_read++;
+
+        // Add to frequency list of previous word
+        MarkovNode *curr_markov = (MarkovNode*)current->data;
+        if (markov_chain->tail &&
+            add_node_to_frequencies_list(markov_chain->tail,
+                                         curr_markov) != 0) {
+#ifdef DEBUG
+            printf("Failed to add to frequency list: %s -> %s\n",
+                   markov_chain->tail->data, curr_markov->data);
+#endif
+            stats_timer_stop(&timer);
+            return -1;
+        }
+        markov_chain->tail = curr_markov;
+        stats_timer_lap(&timer, STATS_INSERT);
+    }
+    stats_timer_lap(&timer, STATS_TOKENIZE);
+    stats_timer_stop(&timer);
+
+#ifdef DEBUG
+    printf("Total words read: %d\n", words_read);
+#endif
+    if (markov_chain->frozen && words_read > 0) {
+        markov_chain->frozen_stale = true;
+    }
+    return words_read;
 }
 
 /**
  * Add second node to first node's frequency list
  */
 int add_node_to_frequencies_list(MarkovNode *first_node, MarkovNode *second_node) {
-    if (!first_node || !second_node) {
+    return add_weighted_node_to_frequencies_list(first_node, second_node, 1);
+}
+
+/**
+ * First slot to probe for a successor id (Fibonacci hashing)
+ */
+static uint32_t successor_slot(uint32_t id, uint32_t capacity) {
+    uint32_t hash = id * 2654435769u;
+    return (hash ^ (hash >> 16)) & (capacity - 1);
+}
+
+/**
+ * Rebuild the successor index with the given capacity, a power of two
+ */
+static int index_successors(MarkovNode *node, uint32_t capacity) {
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (!slots) {
         return 1;
     }
+    for (int i = 0; i < node->frequency_list_size; i++) {
+        uint32_t j = successor_slot(node->frequency_list[i].markov_node->id,
+                                    capacity);
+        while (slots[j]) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = (uint32_t)i + 1;
+    }
+    free(node->successor_slots);
+    node->successor_slots = slots;
+    node->successor_slots_capacity = capacity;
+    return 0;
+}
 
-    // Check if second_node already in frequency list
-    for (int i = 0; i < first_node->frequency_list_size; i++) {
-        if (first_node->frequency_list[i].markov_node == second_node) {
-            first_node->frequency_list[i].frequency++;
-            first_node->total_frequency++;
-            return 0;
+/**
+ * Position of second_node in the frequency list, -1 if it isn't there
+ */
+static int find_successor(const MarkovNode *node,
+                          const MarkovNode *second_node) {
+    if (!node->successor_slots) {
+        for (int i = 0; i < node->frequency_list_size; i++) {
+            if (node->frequency_list[i].markov_node == second_node) {
+                return i;
+            }
         }
+        return -1;
     }
 
-    // Need to add new frequency node
-    MarkovNodeFrequency *new_list = realloc(first_node->frequency_list,
-                                            (first_node->frequency_list_size + 1) *
-                                            sizeof(MarkovNodeFrequency));
-    if (!new_list) {
-        printf(ALLOCATION_ERROR_MASSAGE);
+    uint32_t mask = node->successor_slots_capacity - 1;
+    for (uint32_t j = successor_slot(second_node->id,
+                                     node->successor_slots_capacity);
+         node->successor_slots[j]; j = (j + 1) & mask) {
+        int i = (int)node->successor_slots[j] - 1;
+        if (node->frequency_list[i].markov_node == second_node) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Add count occurrences of second node to first node's frequency list
+ */
+int add_weighted_node_to_frequencies_list(MarkovNode *first_node,
+                                          MarkovNode *second_node, int count) {
+    if (!first_node || !second_node) {
         return 1;
     }
 
+    // The alias table no longer matches the list, sample linearly
+    first_node->alias_threshold = NULL;
+    first_node->alias_index = NULL;
+
+    // Check if second_node already in frequency list
+    int position = find_successor(first_node, second_node);
+    if (position >= 0) {
+        first_node->frequency_list[position].frequency += count;
+        first_node->total_frequency += count;
+        return 0;
+    }
+
+    // Need to add new frequency node, the list doubles when full
+    if (first_node->frequency_list_size == first_node->frequency_list_capacity) {
+        int capacity = first_node->frequency_list_capacity ?
+                       first_node->frequency_list_capacity * 2 : 4;
+        MarkovNodeFrequency *new_list = realloc(first_node->frequency_list,
+                                                capacity *
+                                                sizeof(MarkovNodeFrequency));
+        if (!new_list) {
+            printf(ALLOCATION_ERROR_MASSAGE);
+            return 1;
+        }
+        first_node->frequency_list = new_list;
+        first_node->frequency_list_capacity = capacity;
+    }
+
     // Add the new frequency node
-    first_node->frequency_list = new_list;
-    first_node->frequency_list[first_node->frequency_list_size].markov_node = second_node;
-    first_node->frequency_list[first_node->frequency_list_size].frequency = 1;
+    int size = first_node->frequency_list_size;
+    first_node->frequency_list[size].markov_node = second_node;
+    first_node->frequency_list[size].frequency = count;
     first_node->frequency_list_size++;
-    first_node->total_frequency++;
+    first_node->total_frequency += count;
+
+    // Hub words get a hash index, kept at most half full
+    uint32_t slots_needed = (uint32_t)first_node->frequency_list_size * 2;
+    if (first_node->frequency_list_size >= SUCCESSOR_INDEX_THRESHOLD &&
+        first_node->successor_slots_capacity < slots_needed) {
+        uint32_t capacity = first_node->successor_slots_capacity ?
+                            first_node->successor_slots_capacity * 2 :
+                            SUCCESSOR_INDEX_THRESHOLD * 4;
+        if (index_successors(first_node, capacity) != 0) {
+            printf(ALLOCATION_ERROR_MASSAGE);
+            first_node->frequency_list_size--;
+            first_node->total_frequency -= count;
+            return 1;
+        }
+    } else if (first_node->successor_slots) {
+        uint32_t mask = first_node->successor_slots_capacity - 1;
+        uint32_t j = successor_slot(second_node->id,
+                                    first_node->successor_slots_capacity);
+        while (first_node->successor_slots[j]) {
+            j = (j + 1) & mask;
+        }
+        first_node->successor_slots[j] = (uint32_t)size + 1;
+    }
 
     return 0;
 }
@@ -124,83 +359,86 @@ void free_database(MarkovChain **ptr_chain) {
     MarkovChain *chain = *ptr_chain;
     Node *current = chain->database->first;
 
+    // Frequency lists and their indexes are malloc'ed, everything else
+    // lives in the arena
     while (current != NULL) {
-        Node *next = current->next;  // Save next pointer before freeing current
         MarkovNode *node = (MarkovNode*)current->data;
-        free(node->data);
         free(node->frequency_list);
-        free(node);
-        free(current);  // Add this line to free the Node structure
-        current = next;
+        free(node->successor_slots);
+        current = current->next;
     }
 
+    arena_free(&chain->arena);
+    free(chain->start_nodes);
+    free_frozen_chain(&chain->frozen);
+    word_index_destroy(&chain->index);
     free(chain->database);
     free(chain);
     *ptr_chain = NULL;
 }
 
 /**
- * Get random first node that isn't a sentence ending
+ * Build the CSR copy and point every node at its alias table in it
  */
-MarkovNode* get_first_random_node(MarkovChain *markov_chain) {
-    if (!markov_chain || !markov_chain->database ||
-        !markov_chain->database->first || markov_chain->database->size == 0) {
-#ifdef DEBUG
-        printf("Invalid chain or database\n");
-#endif
-        return NULL;
+int freeze_markov_chain(MarkovChain *markov_chain) {
+    if (!markov_chain || !markov_chain->database) {
+        return 1;
     }
 
-#ifdef DEBUG
-    printf("Database size: %d\n", markov_chain->database->size);
-#endif
-
-    int max_attempts = 1000;
-    while (max_attempts-- > 0) {
-        int index = get_random_number(markov_chain->database->size);
-        Node *current = markov_chain->database->first;
-
-#ifdef DEBUG
-        printf("Trying index: %d\n", index);
-#endif
-
-        for (int i = 0; i < index && current != NULL; i++) {
-            current = current->next;
-        }
+    FrozenChain *frozen_chain = new_frozen_chain(markov_chain);
+    if (!frozen_chain) {
+        return 1;
+    }
 
-        if (!current) {
-#ifdef DEBUG
-            printf("Null node at index %d\n", index);
-#endif
-            continue;
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *node = (MarkovNode*)current->data;
+        uint32_t first_edge = frozen_chain->offsets[node->id];
+        if (node->frequency_list_size == 0) {
+            node->alias_threshold = NULL;
+            node->alias_index = NULL;
+        } else {
+            node->alias_threshold = frozen_chain->alias_threshold + first_edge;
+            node->alias_index = frozen_chain->alias_index + first_edge;
         }
+    }
 
-        if (!current->data) {
-#ifdef DEBUG
-            printf("Null data at index %d\n", index);
-#endif
-            continue;
-        }
+    free_frozen_chain(&markov_chain->frozen);
+    markov_chain->frozen = frozen_chain;
+    markov_chain->frozen_stale = false;
+    return 0;
+}
 
-        MarkovNode *node = (MarkovNode*)current->data;
-        if (!node->data) {
-#ifdef DEBUG
-            printf("Null string at index %d\n", index);
-#endif
-            continue;
-        }
+/**
+ * Refreeze a stale chain on first use
+ */
+FrozenChain* get_frozen_chain(MarkovChain *markov_chain) {
+    if (!markov_chain || !markov_chain->frozen) {
+        return NULL;
+    }
+    if (markov_chain->frozen_stale && freeze_markov_chain(markov_chain) != 0) {
+        return NULL;
+    }
+    return markov_chain->frozen;
+}
 
-        if (!node->is_last) {
+/**
+ * Get random first node that isn't a sentence ending
+ */
+MarkovNode* get_first_random_node(MarkovChain *markov_chain) {
+    if (!markov_chain || markov_chain->start_count == 0) {
 #ifdef DEBUG
-            printf("Found valid node at index %d with data: %s\n", index, node->data);
+        printf("Invalid chain or no possible first word\n");
 #endif
-            return node;
-        }
+        return NULL;
     }
+
+    int index = get_random_number((int)markov_chain->start_count);
 #ifdef DEBUG
-    printf("Failed to find valid node after %d attempts\n", 1000);
+    printf("Start candidate %d of %u: %s\n", index, markov_chain->start_count,
+           markov_chain->start_nodes[index]->data);
 #endif
-    return NULL;
+    return markov_chain->start_nodes[index];
 }
 
 /**
@@ -229,6 +467,20 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr) {
            state_struct_ptr->total_frequency);
 #endif
 
+    if (state_struct_ptr->alias_threshold) {
+        int column = get_random_number(state_struct_ptr->frequency_list_size);
+        int coin = get_random_number(state_struct_ptr->total_frequency);
+        uint32_t i = sample_alias_table(state_struct_ptr->alias_threshold,
+                                        state_struct_ptr->alias_index,
+                                        (uint32_t)column, (uint32_t)coin);
+        markov_stats_count_sample(1);
+#ifdef DEBUG
+        printf("Selected next word from alias table: %s\n",
+               state_struct_ptr->frequency_list[i].markov_node->data);
+#endif
+        return state_struct_ptr->frequency_list[i].markov_node;
+    }
+
     int r = get_random_number(state_struct_ptr->total_frequency);
 #ifdef DEBUG
     printf("Random number: %d\n", r);
@@ -244,6 +496,7 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr) {
         }
         count += state_struct_ptr->frequency_list[i].frequency;
         if (r < count) {
+            markov_stats_count_sample((uint64_t)i + 1);
 #ifdef DEBUG
             printf("Selected next word: %s\n",
                    state_struct_ptr->frequency_list[i].markov_node->data);
@@ -255,6 +508,8 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr) {
 #ifdef DEBUG
     printf("Warning: fell through to default case\n");
 #endif
+    markov_stats_count_sample(
+        (uint64_t)state_struct_ptr->frequency_list_size);
     if (state_struct_ptr->frequency_list_size > 0) {
         return state_struct_ptr->frequency_list[0].markov_node;
     }
@@ -262,32 +517,41 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr) {
 }
 
 /**
- * Generate a random tweet
+ * Generate a random tweet and print it
  */
 int generate_tweet(MarkovNode *first_node, MarkovChain *markov_chain, FILE* out) {
-    if (!first_node || !markov_chain || !out) {
+    if (!out) {
 #ifdef DEBUG
         printf("generate_tweet: null parameters\n");
 #endif
         return -1;
     }
 
-    if (!first_node->data) {
-#ifdef DEBUG
-        printf("generate_tweet: first node has null data\n");
-#endif
-        return -1;
+    OutputBuffer buffer;
+    output_buffer_init(&buffer, OUTPUT_BUFFER_NO_FD, 0);
+    int words = generate_tweet_to_buffer(first_node, markov_chain, &buffer,
+                                         NULL);
+    if (words > 0) {
+        fwrite(buffer.data, 1, buffer.length, out);
     }
+    output_buffer_free(&buffer);
+    return words;
+}
 
+/**
+ * Walk the chain from first_node, appending words as they are drawn
+ */
+static int walk_tweet(MarkovNode *first_node, OutputBuffer *out,
+                      TweetSpan *span) {
     int words = 0;
     MarkovNode *current = first_node;
 
-    // Store words temporarily in case we need to discard them
-    char tweet[MAX_TWEET_LENGTH * 100] = ""; // Buffer for storing the tweet
-    char temp[100]; // Temporary buffer for each word
-
-    // Add first word
-    strcpy(tweet, current->data);
+    // Words go straight to the buffer, which is rolled back on failure
+    size_t start = out->length;
+    if (output_buffer_append(out, current->data, strlen(current->data)) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return -1;
+    }
     words++;
 
     // Generate rest of tweet
@@ -301,37 +565,65 @@ int generate_tweet(MarkovNode *first_node, MarkovChain *markov_chain, FILE* out)
             break;
         }
 
-        // Add space and word to temporary tweet
-        sprintf(temp, " %s", next->data);
-        strcat(tweet, temp);
+        // Add space and word to the tweet
+        if (output_buffer_append_char(out, ' ') != 0 ||
+            output_buffer_append(out, next->data, strlen(next->data)) != 0) {
+            printf(ALLOCATION_ERROR_MASSAGE);
+            break;
+        }
         words++;
 
         current = next;
 
-        // If we hit end of sentence (period)
-        if (current->is_last) {
-            // Only print if we have at least 2 words
-            if (words >= 2) {
-                fprintf(out, "%s\n", tweet);
-                return words;
+        // End of sentence (period), or maximal length without one
+        if (current->is_last || words >= MAX_TWEET_LENGTH) {
+            if (output_buffer_append_char(out, '\n') != 0) {
+                printf(ALLOCATION_ERROR_MASSAGE);
+                break;
+            }
+            if (span) {
+                *span = (TweetSpan) {start, out->length - start};
             }
-            // If less than 2 words, continue generating
-            continue;
-        }
-
-        // If we hit max length without finding a period, print anyway
-        if (words >= MAX_TWEET_LENGTH) {
-            fprintf(out, "%s\n", tweet);
             return words;
         }
     }
 
-    // If we get here without printing, it means we didn't find a proper ending
-    // Try to generate a new tweet instead
-//    MarkovNode* new_first = get_first_random_node(markov_chain);
-//    if (new_first) {
-//        return generate_tweet(new_first, markov_chain, out);
-//    }
-
+    // No proper ending, take the partial tweet back
+    output_buffer_truncate(out, start);
     return -1;
-}
\ No newline at end of file
+}
+
+/**
+ * Generate a random tweet at the end of an output buffer
+ */
+int generate_tweet_to_buffer(MarkovNode *first_node, MarkovChain *markov_chain,
+                             OutputBuffer *out, TweetSpan *span) {
+    if (!first_node || !markov_chain || !out) {
+#ifdef DEBUG
+        printf("generate_tweet: null parameters\n");
+#endif
+        return -1;
+    }
+
+    if (!first_node->data) {
+#ifdef DEBUG
+        printf("generate_tweet: first node has null data\n");
+#endif
+        return -1;
+    }
+
+    // A frozen chain is walked over its dense arrays
+    if (markov_chain->frozen) {
+        FrozenChain *frozen_chain = get_frozen_chain(markov_chain);
+        if (!frozen_chain) {
+            return -1;
+        }
+        return frozen_generate_tweet(frozen_chain, first_node->id, NULL, out,
+                                     span);
+    }
+
+    uint64_t start = markov_stats_enabled ? markov_stats_now() : 0;
+    int words = walk_tweet(first_node, out, span);
+    markov_stats_add_time(STATS_GENERATE, start);
+    return words;
+}
@@ -2,6 +2,10 @@
 #define _MARKOV_CHAIN_H_
 
 #include "linked_list.h"
+#include "word_index.h"
+#include "arena.h"
+#include "alias_table.h"
+#include "output_buffer.h"
 #include <stdio.h>  // For printf(), sscanf()
 #include <stdlib.h> // For malloc()
 #include <stdbool.h> // for bool
@@ -11,17 +15,37 @@
             "new memory\n"
 
 #define MAX_TWEET_LENGTH 20
+#define SUCCESSOR_INDEX_THRESHOLD 16
+#define DELIMITERS " \n\t\r"
 
 typedef struct MarkovChain{
     LinkedList *database;
+    WordIndex index; // word -> Node in database, for O(1) lookups
+    Arena arena;     // nodes, list links and words of the database
+    struct FrozenChain *frozen; // CSR copy built by freeze_markov_chain()
+    bool frozen_stale; // trained since frozen, rebuilt before next use
+    struct MarkovNode *tail; // last word trained on, NULL if none
+    // Nodes that may start a tweet (not sentence endings), in database order
+    struct MarkovNode **start_nodes;
+    uint32_t start_count;
+    uint32_t start_capacity;
 } MarkovChain;
 
 typedef struct MarkovNode{
     char *data;
+    uint32_t id; // position in the database
     struct MarkovNodeFrequency* frequency_list;
     int frequency_list_size;
+    int frequency_list_capacity; // grows geometrically
+    // Successor id -> position in frequency_list + 1, 0 for an empty slot.
+    // Only built once the list reaches SUCCESSOR_INDEX_THRESHOLD entries.
+    uint32_t *successor_slots;
+    uint32_t successor_slots_capacity;
     int total_frequency;
     bool is_last;
+    // Alias table over frequency_list, NULL unless the chain is frozen
+    const uint32_t *alias_threshold;
+    const uint32_t *alias_index;
 } MarkovNode;
 
 typedef struct MarkovNodeFrequency{
@@ -37,6 +61,12 @@ typedef struct MarkovNodeFrequency{
  */
 int get_random_number(int max_number);
 
+/**
+ * Create a new empty markov_chain with an empty database.
+ * @return the new chain, NULL in case of memory allocation failure.
+ */
+MarkovChain* new_markov_chain(void);
+
 /**
 * Check if data_ptr is in database. If so, return the Node wrapping it in
  * the markov_chain, otherwise return NULL.
@@ -57,6 +87,35 @@ Node* get_node_from_database(MarkovChain *markov_chain, char *data_ptr);
  */
 Node* add_to_database(MarkovChain *markov_chain, char *data_ptr);
 
+/**
+ * Same as add_to_database(), for a word that is not NUL terminated, e.g.
+ * a view into a larger text. The bytes are copied into the chain.
+ * @param markov_chain the chain to look in its database
+ * @param word first byte of the word
+ * @param length number of bytes in the word, must be positive
+ * @return Node wrapping the word in given chain's database,
+ * returns NULL in case of memory allocation failure.
+ */
+Node* add_word_to_database(MarkovChain *markov_chain, const char *word,
+                           size_t length);
+
+
+/**
+ * Train the chain on more text, continuing from its tail: training on A
+ * then on B gives the same chain as training on A followed by B, provided
+ * A ends with a delimiter (see DELIMITERS). Otherwise a word split across
+ * the two texts is counted as two words. Words
+ * and counts are updated in place, so the cost only depends on the new
+ * text. A frozen copy of the chain is marked stale and rebuilt the next
+ * time it is needed (see get_frozen_chain()).
+ * @param markov_chain the chain to train
+ * @param text the text, need not be NUL terminated
+ * @param size number of bytes in text
+ * @param words_to_read maximal number of words to read, -1 for all
+ * @return number of words read, -1 in case of allocation failure
+ */
+int train_markov_chain(MarkovChain *markov_chain, const char *text,
+                       size_t size, int words_to_read);
 
 /**
  * Add the second markov_node to the frequency list of the first markov_node.
@@ -68,6 +127,17 @@ Node* add_to_database(MarkovChain *markov_chain, char *data_ptr);
  */
 int add_node_to_frequencies_list(MarkovNode *first_node , MarkovNode *second_node);
 
+/**
+ * Same as add_node_to_frequencies_list(), for count occurrences at once.
+ * @param first_node
+ * @param second_node
+ * @param count number of occurrences to add, positive
+ * @return success/failure: 0 if the process was successful, 1 if in
+ * case of allocation error.
+ */
+int add_weighted_node_to_frequencies_list(MarkovNode *first_node,
+                                          MarkovNode *second_node, int count);
+
 /**
  * Free markov_chain and all of it's content from memory
  * @param markov_chain markov_chain to free
@@ -75,9 +145,35 @@ int add_node_to_frequencies_list(MarkovNode *first_node , MarkovNode *second_nod
 void free_database(MarkovChain ** ptr_chain);
 
 /**
- * Get one random MarkovNode from the given markov_chain's database.
+ * Freeze the markov_chain after training: compact it into a FrozenChain
+ * (dense CSR arrays indexed by node id) with an alias table for the
+ * frequency list of every node. get_next_random_node() then samples in
+ * constant time with the same distribution, and generate_tweet() walks
+ * the dense arrays. Adding a successor to a node afterwards drops its
+ * table and it falls back to the linear scan. Training with
+ * train_markov_chain() marks the frozen copy stale, and generate_tweet()
+ * freezes the chain again before walking it; after adding nodes or
+ * successors by hand, freeze it again explicitly.
+ * @param markov_chain the chain to freeze
+ * @return 0 on success, 1 in case of allocation failure.
+ */
+int freeze_markov_chain(MarkovChain *markov_chain);
+
+/**
+ * Get the frozen copy of the chain, freezing it again first if it was
+ * trained since.
+ * @param markov_chain the chain
+ * @return the up to date frozen chain, NULL if the chain was never frozen
+ * or in case of allocation failure.
+ */
+struct FrozenChain* get_frozen_chain(MarkovChain *markov_chain);
+
+/**
+ * Get one random MarkovNode from the given markov_chain's database, drawn
+ * uniformly among the nodes that are not sentence endings. The candidates
+ * are kept in a dense array as words are added, so this is a single draw.
  * @param markov_chain
- * @return the random MarkovNode
+ * @return the random MarkovNode, NULL if every word ends a sentence
  */
 MarkovNode* get_first_random_node(MarkovChain *markov_chain);
 
@@ -105,5 +201,17 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr);
  */
 int generate_tweet(MarkovNode *first_node, MarkovChain *markov_chain, FILE* out);
 
+/**
+ * Same as generate_tweet(), appending the tweet (and its newline) to an
+ * output buffer instead of printing it. Nothing is appended on failure.
+ * @param first_node first word in chain
+ * @param markov_chain the chain to use
+ * @param out buffer to append the tweet to
+ * @param span if not NULL, set to the bytes of the tweet in out
+ * @return Number of words in tweet, -1 on failure
+ */
+int generate_tweet_to_buffer(MarkovNode *first_node, MarkovChain *markov_chain,
+                             OutputBuffer *out, TweetSpan *span);
+
 
 #endif /* _MARKOV_CHAIN_H_ */
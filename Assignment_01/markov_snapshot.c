@@ -0,0 +1,168 @@
+#include "markov_snapshot.h"
+#include <fcntl.h>    // For open()
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h> // For fstat()
+#include <unistd.h>   // For close()
+
+#define SNAPSHOT_ERROR "Error: %s is not a valid model snapshot\n"
+
+/**
+ * Write the header and the storage block
+ */
+int save_markov_snapshot(const FrozenChain *frozen_chain, const char *path) {
+    if (!frozen_chain || !path) {
+        return 1;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MARKOV_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = MARKOV_SNAPSHOT_VERSION;
+    header.byte_order = MARKOV_SNAPSHOT_BYTE_ORDER;
+    header.num_nodes = frozen_chain->num_nodes;
+    header.num_edges = frozen_chain->num_edges;
+    header.num_starts = frozen_chain->num_starts;
+    header.tail = frozen_chain->tail;
+    header.flags = frozen_chain->compact ? MARKOV_SNAPSHOT_COMPACT : 0;
+    header.words_size = frozen_chain->words_size;
+    header.storage_size = frozen_chain_storage_size(frozen_chain->num_nodes,
+                                                    frozen_chain->num_edges,
+                                                    frozen_chain->num_starts,
+                                                    frozen_chain->words_size,
+                                                    frozen_chain->compact);
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        return 1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, fp) != 1 ||
+                 fwrite(frozen_chain->storage, 1, header.storage_size, fp) !=
+                 header.storage_size;
+    if (fclose(fp) != 0) {
+        failed = 1;
+    }
+    return failed;
+}
+
+/**
+ * Check that the mapped file holds a snapshot this build can read
+ */
+static bool valid_header(const SnapshotHeader *header, size_t file_size) {
+    if (file_size < sizeof(SnapshotHeader) ||
+        memcmp(header->magic, MARKOV_SNAPSHOT_MAGIC,
+               sizeof(header->magic)) != 0 ||
+        header->version != MARKOV_SNAPSHOT_VERSION ||
+        header->byte_order != MARKOV_SNAPSHOT_BYTE_ORDER) {
+        return false;
+    }
+    // Bound words_size by the file first, so the size below can't wrap around
+    return (header->flags & ~MARKOV_SNAPSHOT_COMPACT) == 0 &&
+           header->num_starts <= header->num_nodes &&
+           (header->tail < header->num_nodes ||
+            header->tail == FROZEN_NO_NODE) &&
+           header->words_size <= file_size - sizeof(SnapshotHeader) &&
+           header->storage_size != SIZE_MAX &&
+           header->storage_size ==
+           frozen_chain_storage_size(header->num_nodes, header->num_edges,
+                                     header->num_starts, header->words_size,
+                                     header->flags & MARKOV_SNAPSHOT_COMPACT) &&
+           header->storage_size <= file_size - sizeof(SnapshotHeader);
+}
+
+/**
+ * Check every index the walks follow, once, so that a truncated or corrupt
+ * file is rejected instead of read out of bounds: offsets from 0 to
+ * num_edges without going back, successor and start ids, alias indexes
+ * within their node, word offsets within NUL terminated words, and a
+ * non-zero total for every node that has successors
+ */
+static bool valid_storage(const FrozenChain *frozen_chain) {
+    uint32_t num_nodes = frozen_chain->num_nodes;
+    if (frozen_chain->offsets[0] != 0 ||
+        frozen_chain->offsets[num_nodes] != frozen_chain->num_edges ||
+        (num_nodes > 0 && (frozen_chain->words_size == 0 ||
+                           frozen_chain->words[frozen_chain->words_size - 1] != '\0'))) {
+        return false;
+    }
+
+    for (uint32_t id = 0; id < num_nodes; id++) {
+        uint32_t first_edge = frozen_chain->offsets[id];
+        uint32_t end_edge = frozen_chain->offsets[id + 1];
+        if (end_edge < first_edge ||
+            frozen_chain->word_offsets[id] >= frozen_chain->words_size ||
+            (end_edge > first_edge && frozen_chain->totals[id] == 0)) {
+            return false;
+        }
+        uint32_t degree = end_edge - first_edge;
+        for (uint32_t edge = first_edge; edge < end_edge; edge++) {
+            uint32_t alias = frozen_chain->compact ?
+                             frozen_chain->alias_index16[edge] :
+                             frozen_chain->alias_index[edge];
+            if (frozen_chain->successors[edge] >= num_nodes || alias >= degree) {
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < frozen_chain->num_starts; i++) {
+        if (frozen_chain->start_ids[i] >= num_nodes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Map the file and point a frozen chain into it
+ */
+FrozenChain* load_markov_snapshot(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        printf(SNAPSHOT_ERROR, path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t mapping_size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const SnapshotHeader *header = mapping;
+    if (!valid_header(header, mapping_size)) {
+        printf(SNAPSHOT_ERROR, path);
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+
+    FrozenChain *frozen_chain = malloc(sizeof(FrozenChain));
+    if (!frozen_chain) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        munmap(mapping, mapping_size);
+        return NULL;
+    }
+    frozen_chain->num_nodes = header->num_nodes;
+    frozen_chain->num_edges = header->num_edges;
+    frozen_chain->num_starts = header->num_starts;
+    frozen_chain->tail = header->tail;
+    frozen_chain->compact = (header->flags & MARKOV_SNAPSHOT_COMPACT) != 0;
+    frozen_chain->words_size = header->words_size;
+    frozen_chain_attach(frozen_chain, (char *)mapping + sizeof(SnapshotHeader));
+    frozen_chain->mapping = mapping;
+    frozen_chain->mapping_size = mapping_size;
+
+    if (!valid_storage(frozen_chain)) {
+        printf(SNAPSHOT_ERROR, path);
+        free_frozen_chain(&frozen_chain);
+        return NULL;
+    }
+
+    return frozen_chain;
+}
@@ -0,0 +1,51 @@
+#ifndef _MARKOV_SNAPSHOT_H_
+#define _MARKOV_SNAPSHOT_H_
+
+#include "frozen_chain.h"
+
+#define MARKOV_SNAPSHOT_MAGIC "MKVCHAIN"
+#define MARKOV_SNAPSHOT_VERSION 4
+#define MARKOV_SNAPSHOT_BYTE_ORDER 0x01020304u
+#define MARKOV_SNAPSHOT_COMPACT 0x1u // flag: FrozenChain::compact
+
+/**
+ * On-disk model: this header followed by the FrozenChain storage block
+ * exactly as frozen_chain_attach() lays it out, in native byte order.
+ * Loading maps the file and points the arrays into the mapping, so no
+ * parsing or per-node allocation happens.
+ */
+typedef struct SnapshotHeader {
+    char magic[8];         // MARKOV_SNAPSHOT_MAGIC, not NUL terminated
+    uint32_t version;      // MARKOV_SNAPSHOT_VERSION
+    uint32_t byte_order;   // MARKOV_SNAPSHOT_BYTE_ORDER as written
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t num_starts;
+    uint32_t tail;         // FrozenChain::tail
+    uint32_t flags;        // MARKOV_SNAPSHOT_COMPACT or 0
+    uint32_t reserved;     // zero
+    uint64_t words_size;
+    uint64_t storage_size; // bytes following the header
+} SnapshotHeader;
+
+/**
+ * Write a frozen chain to a snapshot file.
+ * @param frozen_chain the chain to save
+ * @param path file to create or overwrite
+ * @return 0 on success, 1 if the file could not be written
+ */
+int save_markov_snapshot(const FrozenChain *frozen_chain, const char *path);
+
+/**
+ * Map a snapshot file as a read-only frozen chain. Free it with
+ * free_frozen_chain(), which unmaps the file. Before the chain is used,
+ * every node and edge is read once to check its ids and offsets: loading
+ * is O(nodes + edges) and touches every page of the file, about a
+ * millisecond per 4 MB when the file is cached.
+ * @param path snapshot file
+ * @return the frozen chain, NULL if the file can't be mapped or is not a
+ * snapshot of the current version
+ */
+FrozenChain* load_markov_snapshot(const char *path);
+
+#endif /* _MARKOV_SNAPSHOT_H_ */
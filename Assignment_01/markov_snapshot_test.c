@@ -0,0 +1,167 @@
+#include "markov_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#define TEST_SNAPSHOT "test_snapshot.bin"
+#define GREEN "\033[0;32m"
+#define RED "\033[0;31m"
+#define RESET "\033[0m"
+
+int passed_tests = 0;
+int total_tests = 0;
+
+void print_test_result(const char* test_name, int passed) {
+    total_tests++;
+    if (passed) {
+        passed_tests++;
+        printf("%s✓ %s: PASSED%s\n", GREEN, test_name, RESET);
+    } else {
+        printf("%s✗ %s: FAILED%s\n", RED, test_name, RESET);
+    }
+}
+
+/**
+ * A two word chain, "a" -> "b", in a block of its own
+ */
+FrozenChain* new_test_chain() {
+    FrozenChain *frozen_chain = calloc(1, sizeof(FrozenChain));
+    frozen_chain->num_nodes = 2;
+    frozen_chain->num_edges = 1;
+    frozen_chain->num_starts = 1;
+    frozen_chain->tail = 1;
+    frozen_chain->words_size = 4;
+    frozen_chain->storage = calloc(1, frozen_chain_storage_size(2, 1, 1, 4, false));
+    frozen_chain_attach(frozen_chain, frozen_chain->storage);
+
+    uint32_t *offsets = (uint32_t *)frozen_chain->offsets;
+    offsets[0] = 0;
+    offsets[1] = 1;
+    offsets[2] = 1;
+    ((uint32_t *)frozen_chain->totals)[0] = 1;
+    ((uint32_t *)frozen_chain->word_offsets)[1] = 2;
+    ((uint8_t *)frozen_chain->is_last)[1] = 1;
+    ((uint32_t *)frozen_chain->successors)[0] = 1;
+    ((uint32_t *)frozen_chain->counts)[0] = 1;
+    ((uint32_t *)frozen_chain->alias_threshold)[0] = 1;
+    memcpy((char *)frozen_chain->words, "a\0b", 4);
+    return frozen_chain;
+}
+
+/**
+ * Overwrite part of the saved snapshot; offset counts from the start of the file
+ */
+void patch_snapshot(long offset, const void *data, size_t size) {
+    FILE *fp = fopen(TEST_SNAPSHOT, "r+b");
+    fseek(fp, offset, SEEK_SET);
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+}
+
+/**
+ * Offset in the file of a field of the chain's storage block
+ */
+long storage_offset(const FrozenChain *frozen_chain, const void *field) {
+    return (long)sizeof(SnapshotHeader) +
+           (long)((const char *)field - (const char *)frozen_chain->storage);
+}
+
+int loads() {
+    FrozenChain *loaded = load_markov_snapshot(TEST_SNAPSHOT);
+    int result = loaded != NULL;
+    free_frozen_chain(&loaded);
+    return result;
+}
+
+void test_valid_snapshot(FrozenChain *frozen_chain) {
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    FrozenChain *loaded = load_markov_snapshot(TEST_SNAPSHOT);
+    print_test_result("Valid snapshot loads",
+                      loaded != NULL && loaded->num_nodes == 2 &&
+                      strcmp(frozen_chain_word(loaded, 1), "b") == 0 &&
+                      frozen_chain_next(loaded, 0, NULL) == 1);
+    free_frozen_chain(&loaded);
+}
+
+// words_size near 2^64 with a storage_size made to match the wrapped sum
+void test_overflowing_sizes(FrozenChain *frozen_chain) {
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    uint64_t words_size = UINT64_MAX;
+    uint64_t wrapped = frozen_chain_storage_size(2, 1, 1, 0, false);
+    patch_snapshot(offsetof(SnapshotHeader, words_size), &words_size, sizeof(words_size));
+    patch_snapshot(offsetof(SnapshotHeader, storage_size), &wrapped, sizeof(wrapped));
+    uint32_t far_offset = 0x40000000;
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->word_offsets),
+                   &far_offset, sizeof(far_offset));
+    print_test_result("Overflowing words_size is rejected", !loads());
+    print_test_result("Overflowing size saturates",
+                      frozen_chain_storage_size(UINT32_MAX, UINT32_MAX, UINT32_MAX,
+                                                UINT64_MAX - 3, false) == SIZE_MAX);
+}
+
+void test_words_size_beyond_file(FrozenChain *frozen_chain) {
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    uint64_t words_size = 1 << 20;
+    uint64_t storage_size = frozen_chain_storage_size(2, 1, 1, words_size, false);
+    patch_snapshot(offsetof(SnapshotHeader, words_size), &words_size, sizeof(words_size));
+    patch_snapshot(offsetof(SnapshotHeader, storage_size), &storage_size, sizeof(storage_size));
+    print_test_result("words_size beyond the file is rejected", !loads());
+}
+
+void test_truncated_file(FrozenChain *frozen_chain) {
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    FILE *fp = fopen(TEST_SNAPSHOT, "r+b");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    truncate(TEST_SNAPSHOT, size - 8);
+    print_test_result("Truncated file is rejected", !loads());
+}
+
+void test_corrupt_indexes(FrozenChain *frozen_chain) {
+    uint32_t bad = 7;
+    uint32_t offset = 2;
+
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->successors), &bad, sizeof(bad));
+    print_test_result("Successor out of range is rejected", !loads());
+
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->start_ids), &bad, sizeof(bad));
+    print_test_result("Start id out of range is rejected", !loads());
+
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->alias_index), &bad, sizeof(bad));
+    print_test_result("Alias index out of range is rejected", !loads());
+
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->word_offsets + 1), &bad, sizeof(bad));
+    print_test_result("Word offset out of range is rejected", !loads());
+
+    // offsets 0, 2, 1: node 1 would have a negative degree
+    save_markov_snapshot(frozen_chain, TEST_SNAPSHOT);
+    patch_snapshot(storage_offset(frozen_chain, frozen_chain->offsets + 1), &offset, sizeof(offset));
+    print_test_result("Decreasing offsets are rejected", !loads());
+}
+
+int main() {
+    printf("\n🚀 Starting Markov Snapshot Tests...\n\n");
+
+    FrozenChain *frozen_chain = new_test_chain();
+    test_valid_snapshot(frozen_chain);
+    test_overflowing_sizes(frozen_chain);
+    test_words_size_beyond_file(frozen_chain);
+    test_truncated_file(frozen_chain);
+    test_corrupt_indexes(frozen_chain);
+    free_frozen_chain(&frozen_chain);
+    remove(TEST_SNAPSHOT);
+
+    // Print summary
+    printf("\n📊 Test Summary:\n");
+    printf("Passed: %d\n", passed_tests);
+    printf("Failed: %d\n", total_tests - passed_tests);
+    printf("Total: %d\n", total_tests);
+    return (passed_tests == total_tests) ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#include "markov_stats.h"
+#include <time.h> // For clock_gettime()
+
+bool markov_stats_enabled = false;
+MarkovCounters markov_counters;
+
+static const char *PHASE_NAMES[STATS_NUM_PHASES] = {
+    "tokenize", "lookup", "insert", "generate"
+};
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+uint64_t markov_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * One atomic add per phase, however many laps there were
+ */
+void stats_timer_stop(const StatsTimer *timer) {
+    if (!markov_stats_enabled) {
+        return;
+    }
+    for (int phase = 0; phase < STATS_NUM_PHASES; phase++) {
+        if (timer->elapsed[phase]) {
+            atomic_fetch_add_explicit(&markov_counters.nanoseconds[phase],
+                                      timer->elapsed[phase],
+                                      memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Zero every counter
+ */
+void markov_stats_reset(void) {
+    for (int phase = 0; phase < STATS_NUM_PHASES; phase++) {
+        atomic_store_explicit(&markov_counters.nanoseconds[phase], 0,
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&markov_counters.samples, 0, memory_order_relaxed);
+    atomic_store_explicit(&markov_counters.scanned, 0, memory_order_relaxed);
+}
+
+/**
+ * Histogram bucket of an out-degree: 0, then one per power of two
+ */
+static int degree_bucket(uint32_t degree) {
+    int bucket = 0;
+    while (degree) {
+        bucket++;
+        degree >>= 1;
+    }
+    return bucket;
+}
+
+/**
+ * Count one node of the given out-degree
+ */
+static void add_degree(MarkovStats *stats, uint32_t degree) {
+    stats->degree_histogram[degree_bucket(degree)]++;
+    stats->edges += degree;
+    if (degree > stats->max_degree) {
+        stats->max_degree = degree;
+    }
+}
+
+/**
+ * Walk the database, or the CSR arrays of a snapshot
+ */
+void markov_stats_collect(const MarkovChain *markov_chain,
+                          const FrozenChain *frozen_chain, MarkovStats *stats) {
+    memset(stats, 0, sizeof(MarkovStats));
+
+    if (markov_chain) {
+        stats->vocabulary = markov_chain->database->size;
+        stats->start_words = markov_chain->start_count;
+        stats->node_bytes =
+            (uint64_t)markov_chain->index.capacity * sizeof(WordIndexSlot) +
+            (uint64_t)markov_chain->start_capacity * sizeof(MarkovNode*);
+        for (Node *current = markov_chain->database->first; current != NULL;
+             current = current->next) {
+            MarkovNode *node = (MarkovNode*)current->data;
+            add_degree(stats, (uint32_t)node->frequency_list_size);
+            stats->node_bytes += sizeof(MarkovNode) + sizeof(Node);
+            stats->string_bytes += strlen(node->data) + 1;
+            stats->edge_bytes +=
+                (uint64_t)node->frequency_list_capacity *
+                sizeof(MarkovNodeFrequency) +
+                (uint64_t)node->successor_slots_capacity * sizeof(uint32_t);
+        }
+        const FrozenChain *frozen = markov_chain->frozen;
+        if (frozen) {
+            stats->frozen_bytes = frozen_chain_storage_size(
+                frozen->num_nodes, frozen->num_edges, frozen->num_starts,
+                frozen->words_size, frozen->compact);
+        }
+    } else if (frozen_chain) {
+        // Offsets, totals, word offsets and end flags per node
+        uint64_t n = frozen_chain->num_nodes;
+        uint64_t count_size = frozen_chain->compact ? sizeof(uint16_t) :
+                                                      sizeof(uint32_t);
+        stats->vocabulary = n;
+        stats->start_words = frozen_chain->num_starts;
+        for (uint32_t id = 0; id < frozen_chain->num_nodes; id++) {
+            add_degree(stats, frozen_chain->offsets[id + 1] -
+                              frozen_chain->offsets[id]);
+        }
+        stats->node_bytes = (3 * n + 1) * sizeof(uint32_t) + n +
+                            (uint64_t)frozen_chain->num_starts *
+                            sizeof(uint32_t);
+        stats->string_bytes = frozen_chain->words_size;
+        stats->edge_bytes = (uint64_t)frozen_chain->num_edges *
+                            (sizeof(uint32_t) + 3 * count_size);
+    }
+
+    for (int phase = 0; phase < STATS_NUM_PHASES; phase++) {
+        stats->seconds[phase] = (double)atomic_load_explicit(
+            &markov_counters.nanoseconds[phase], memory_order_relaxed) * 1e-9;
+    }
+    stats->samples = atomic_load_explicit(&markov_counters.samples,
+                                          memory_order_relaxed);
+    stats->scanned = atomic_load_explicit(&markov_counters.scanned,
+                                          memory_order_relaxed);
+}
+
+/**
+ * Shape, memory, then time
+ */
+void print_markov_stats(const MarkovStats *stats, FILE *out) {
+    fprintf(out, "Vocabulary: %llu words (%llu may start a tweet)\n",
+            (unsigned long long)stats->vocabulary,
+            (unsigned long long)stats->start_words);
+    fprintf(out, "Edges: %llu, mean out-degree %.2f, max %u\n",
+            (unsigned long long)stats->edges,
+            stats->vocabulary ?
+            (double)stats->edges / (double)stats->vocabulary : 0,
+            stats->max_degree);
+
+    fprintf(out, "Out-degree histogram:\n");
+    for (int bucket = 0; bucket < MARKOV_STATS_DEGREE_BUCKETS; bucket++) {
+        if (!stats->degree_histogram[bucket]) {
+            continue;
+        }
+        uint64_t low = bucket ? (uint64_t)1 << (bucket - 1) : 0;
+        uint64_t high = bucket ? ((uint64_t)1 << bucket) - 1 : 0;
+        char range[48];
+        if (low == high) {
+            snprintf(range, sizeof(range), "%llu", (unsigned long long)low);
+        } else {
+            snprintf(range, sizeof(range), "%llu-%llu",
+                     (unsigned long long)low, (unsigned long long)high);
+        }
+        fprintf(out, "  %-24s %llu\n", range,
+                (unsigned long long)stats->degree_histogram[bucket]);
+    }
+
+    fprintf(out, "Memory: nodes %llu bytes, strings %llu bytes, "
+            "edges %llu bytes, frozen copy %llu bytes\n",
+            (unsigned long long)stats->node_bytes,
+            (unsigned long long)stats->string_bytes,
+            (unsigned long long)stats->edge_bytes,
+            (unsigned long long)stats->frozen_bytes);
+
+    fprintf(out, "Time:");
+    for (int phase = 0; phase < STATS_NUM_PHASES; phase++) {
+        fprintf(out, " %s %.6fs", PHASE_NAMES[phase], stats->seconds[phase]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "Samples: %llu, mean scan length %.2f\n",
+            (unsigned long long)stats->samples,
+            stats->samples ?
+            (double)stats->scanned / (double)stats->samples : 0);
+}
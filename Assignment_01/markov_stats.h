@@ -0,0 +1,170 @@
+#ifndef _MARKOV_STATS_H_
+#define _MARKOV_STATS_H_
+
+#include "markov_chain.h"
+#include "frozen_chain.h"
+#include <stdatomic.h> // For the shared counters
+#include <stdint.h>    // For uint64_t
+
+// Out-degree buckets: 0, 1, 2-3, 4-7, ..., 2^31 and more
+#define MARKOV_STATS_DEGREE_BUCKETS 33
+
+/**
+ * Where training and generation time goes. Tokenize is splitting the
+ * text into words, lookup is finding (or creating) the node of a word,
+ * insert is counting the transition in the previous word's frequency
+ * list, generate is walking the chain to build tweets.
+ */
+typedef enum MarkovStatsPhase {
+    STATS_TOKENIZE,
+    STATS_LOOKUP,
+    STATS_INSERT,
+    STATS_GENERATE,
+    STATS_NUM_PHASES
+} MarkovStatsPhase;
+
+/**
+ * Hot path counters, shared by all threads and only touched while
+ * markov_stats_enabled is set. Relaxed atomics: they are summed, never
+ * used to synchronize anything.
+ */
+typedef struct MarkovCounters {
+    atomic_uint_fast64_t nanoseconds[STATS_NUM_PHASES];
+    atomic_uint_fast64_t samples; // next word draws
+    atomic_uint_fast64_t scanned; // frequency list entries they looked at
+} MarkovCounters;
+
+/**
+ * Per-thread stopwatch: every lap charges the time since the previous one
+ * to a phase, and the totals are added to the shared counters at once.
+ */
+typedef struct StatsTimer {
+    uint64_t last;
+    uint64_t elapsed[STATS_NUM_PHASES];
+} StatsTimer;
+
+/**
+ * Snapshot of a chain's shape and memory, and of the counters.
+ */
+typedef struct MarkovStats {
+    uint64_t vocabulary;
+    uint64_t edges;
+    uint64_t start_words;
+    uint32_t max_degree;
+    uint64_t degree_histogram[MARKOV_STATS_DEGREE_BUCKETS];
+    uint64_t node_bytes;   // nodes, links, word index, start candidates
+    uint64_t string_bytes; // words, NULs included
+    uint64_t edge_bytes;   // frequency lists and successor indexes
+    uint64_t frozen_bytes; // CSR copy of a frozen chain, 0 if none
+    double seconds[STATS_NUM_PHASES]; // summed over threads
+    uint64_t samples;
+    uint64_t scanned;
+} MarkovStats;
+
+// Off by default, set before training to count anything
+extern bool markov_stats_enabled;
+extern MarkovCounters markov_counters;
+
+/**
+ * Nanoseconds on the monotonic clock.
+ * @return the current time
+ */
+uint64_t markov_stats_now(void);
+
+/**
+ * Count one next word draw that looked at scanned frequency list entries.
+ * @param scanned entries compared against the random number, 1 for an
+ * alias table
+ */
+static inline void markov_stats_count_sample(uint64_t scanned) {
+    if (markov_stats_enabled) {
+        atomic_fetch_add_explicit(&markov_counters.samples, 1,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&markov_counters.scanned, scanned,
+                                  memory_order_relaxed);
+    }
+}
+
+/**
+ * Count several next word draws at once.
+ * @param samples number of draws
+ * @param scanned entries they looked at in total
+ */
+static inline void markov_stats_count_samples(uint64_t samples,
+                                              uint64_t scanned) {
+    if (markov_stats_enabled && samples) {
+        atomic_fetch_add_explicit(&markov_counters.samples, samples,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&markov_counters.scanned, scanned,
+                                  memory_order_relaxed);
+    }
+}
+
+/**
+ * Charge the time since start to a phase.
+ * @param phase the phase
+ * @param start markov_stats_now() when the phase began
+ */
+static inline void markov_stats_add_time(MarkovStatsPhase phase,
+                                         uint64_t start) {
+    if (markov_stats_enabled) {
+        atomic_fetch_add_explicit(&markov_counters.nanoseconds[phase],
+                                  markov_stats_now() - start,
+                                  memory_order_relaxed);
+    }
+}
+
+/**
+ * Start a stopwatch, with nothing charged yet.
+ * @param timer the stopwatch
+ */
+static inline void stats_timer_start(StatsTimer *timer) {
+    memset(timer, 0, sizeof(StatsTimer));
+    if (markov_stats_enabled) {
+        timer->last = markov_stats_now();
+    }
+}
+
+/**
+ * Charge the time since the previous lap to a phase.
+ * @param timer the stopwatch
+ * @param phase the phase
+ */
+static inline void stats_timer_lap(StatsTimer *timer,
+                                   MarkovStatsPhase phase) {
+    if (markov_stats_enabled) {
+        uint64_t now = markov_stats_now();
+        timer->elapsed[phase] += now - timer->last;
+        timer->last = now;
+    }
+}
+
+/**
+ * Add the time of a stopwatch to the shared counters.
+ * @param timer the stopwatch
+ */
+void stats_timer_stop(const StatsTimer *timer);
+
+/**
+ * Zero the shared counters.
+ */
+void markov_stats_reset(void);
+
+/**
+ * Measure a chain and read the counters.
+ * @param markov_chain the chain, NULL to measure frozen_chain only
+ * @param frozen_chain a loaded snapshot when markov_chain is NULL,
+ * ignored otherwise
+ * @param stats filled with the results
+ */
+void markov_stats_collect(const MarkovChain *markov_chain,
+                          const FrozenChain *frozen_chain, MarkovStats *stats);
+
+/**
+ * Print stats as human readable lines.
+ * @param stats the stats
+ * @param out stream to print to
+ */
+void print_markov_stats(const MarkovStats *stats, FILE *out);
+
+#endif /* _MARKOV_STATS_H_ */
@@ -0,0 +1,483 @@
+#include "ngram_model.h"
+
+#define NGRAM_INITIAL_CAPACITY 1024
+#define TRANSITION_HASH_MULTIPLIER 0x9e3779b97f4a7c15ull
+
+/**
+ * Hash the packed ids of a context (FNV-1a over their bytes)
+ */
+static uint32_t hash_context(const uint32_t *ids, uint32_t order) {
+    return hash_word((const char *)ids, order * sizeof(uint32_t));
+}
+
+/**
+ * Hash a (context, next word) pair (Fibonacci hashing)
+ */
+static uint32_t hash_transition(uint32_t context, uint32_t next) {
+    uint64_t key = ((uint64_t)context << 32) | next;
+    return (uint32_t)((key * TRANSITION_HASH_MULTIPLIER) >> 32);
+}
+
+/**
+ * Make room for needed elements in a growable array, doubling it
+ */
+static int reserve(void **array, uint32_t *capacity, uint32_t needed,
+                   size_t element_size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    uint32_t new_capacity = *capacity ? *capacity : NGRAM_INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void *new_array = realloc(*array, (size_t)new_capacity * element_size);
+    if (!new_array) {
+        return 1;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * Put value + 1 in the first free slot of a table known to have room
+ */
+static void place_slot(uint32_t *slots, uint32_t capacity, uint32_t hash,
+                       uint32_t value) {
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash & mask;
+    while (slots[i]) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = value + 1;
+}
+
+/**
+ * Make sure a slot table stays at most half full after one more insert,
+ * rehashing the count values it holds with hash_of
+ */
+static int reserve_slots(const NgramModel *model, uint32_t **slots,
+                         uint32_t *capacity, uint32_t count,
+                         uint32_t (*hash_of)(const NgramModel*, uint32_t)) {
+    if ((uint64_t)(count + 1) * 2 <= *capacity) {
+        return 0;
+    }
+    uint32_t new_capacity = *capacity ? *capacity * 2 :
+                            NGRAM_INITIAL_CAPACITY * 2;
+    uint32_t *new_slots = calloc(new_capacity, sizeof(uint32_t));
+    if (!new_slots) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        place_slot(new_slots, new_capacity, hash_of(model, i), i);
+    }
+    free(*slots);
+    *slots = new_slots;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * Stored hash of a context, for rehashing
+ */
+static uint32_t context_hash_at(const NgramModel *model, uint32_t context) {
+    return model->context_hashes[context];
+}
+
+/**
+ * Hash of a transition, for rehashing
+ */
+static uint32_t transition_hash_at(const NgramModel *model,
+                                   uint32_t transition) {
+    const NgramTransition *entry = &model->transitions[transition];
+    return hash_transition(entry->context, entry->next);
+}
+
+/**
+ * Find the index of a context, NGRAM_NO_CONTEXT if it was never seen
+ */
+static uint32_t find_context(const NgramModel *model, const uint32_t *ids,
+                             uint32_t hash) {
+    if (model->context_slots_capacity == 0) {
+        return NGRAM_NO_CONTEXT;
+    }
+
+    uint32_t mask = model->context_slots_capacity - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = model->context_slots[i];
+        if (!slot) {
+            return NGRAM_NO_CONTEXT;
+        }
+        uint32_t context = slot - 1;
+        if (model->context_hashes[context] == hash &&
+            memcmp(model->context_words + (size_t)context * model->order, ids,
+                   model->order * sizeof(uint32_t)) == 0) {
+            return context;
+        }
+    }
+}
+
+/**
+ * Get the index of the context in the training window, adding it if new
+ */
+static uint32_t window_context(NgramModel *model) {
+    uint32_t hash = hash_context(model->window, model->order);
+    uint32_t context = find_context(model, model->window, hash);
+    if (context != NGRAM_NO_CONTEXT) {
+        return context;
+    }
+
+    // context_words and context_hashes share contexts_capacity, which
+    // only moves once both have grown
+    context = model->num_contexts;
+    uint32_t words_capacity = model->contexts_capacity;
+    if (reserve_slots(model, &model->context_slots,
+                      &model->context_slots_capacity, context,
+                      context_hash_at) != 0 ||
+        reserve((void **)&model->context_words, &words_capacity, context + 1,
+                model->order * sizeof(uint32_t)) != 0 ||
+        reserve((void **)&model->context_hashes, &model->contexts_capacity,
+                context + 1, sizeof(uint32_t)) != 0) {
+        return NGRAM_NO_CONTEXT;
+    }
+
+    memcpy(model->context_words + (size_t)context * model->order,
+           model->window, model->order * sizeof(uint32_t));
+    model->context_hashes[context] = hash;
+    place_slot(model->context_slots, model->context_slots_capacity, hash,
+               context);
+    model->num_contexts++;
+    return context;
+}
+
+/**
+ * Count one more occurrence of next after context
+ */
+static int add_transition(NgramModel *model, uint32_t context, uint32_t next) {
+    uint32_t hash = hash_transition(context, next);
+    if (model->transition_slots_capacity > 0) {
+        uint32_t mask = model->transition_slots_capacity - 1;
+        for (uint32_t i = hash & mask; model->transition_slots[i];
+             i = (i + 1) & mask) {
+            NgramTransition *entry =
+                &model->transitions[model->transition_slots[i] - 1];
+            if (entry->context == context && entry->next == next) {
+                entry->count++;
+                return 0;
+            }
+        }
+    }
+
+    uint32_t transition = model->num_transitions;
+    if (reserve_slots(model, &model->transition_slots,
+                      &model->transition_slots_capacity, transition,
+                      transition_hash_at) != 0 ||
+        reserve((void **)&model->transitions, &model->transitions_capacity,
+                transition + 1, sizeof(NgramTransition)) != 0) {
+        return 1;
+    }
+    model->transitions[transition] = (NgramTransition) {context, next, 1};
+    place_slot(model->transition_slots, model->transition_slots_capacity,
+               hash, transition);
+    model->num_transitions++;
+    return 0;
+}
+
+/**
+ * Get the id of a word, adding it to the vocabulary if new
+ */
+static int word_id(NgramModel *model, const char *word, size_t length,
+                   uint32_t *id) {
+    uint32_t hash = hash_word(word, length);
+    void *value = word_index_find(&model->index, word, length, hash);
+    if (value) {
+        *id = (uint32_t)((uintptr_t)value - 1);
+        return 0;
+    }
+
+    // words and is_last share words_capacity, like the context arrays
+    uint32_t is_last_capacity = model->words_capacity;
+    char *data = arena_strndup(&model->arena, word, length);
+    if (!data ||
+        reserve((void **)&model->is_last, &is_last_capacity,
+                model->num_words + 1, sizeof(uint8_t)) != 0 ||
+        reserve((void **)&model->words, &model->words_capacity,
+                model->num_words + 1, sizeof(char *)) != 0) {
+        return 1;
+    }
+
+    *id = model->num_words;
+    if (word_index_insert(&model->index, data, length, hash,
+                          (void *)((uintptr_t)*id + 1)) != 0) {
+        return 1;
+    }
+    model->words[*id] = data;
+    model->is_last[*id] = (word[length - 1] == '.');
+    model->num_words++;
+    return 0;
+}
+
+/**
+ * Free the sampling tables, the model goes back to training
+ */
+static void drop_tables(NgramModel *model) {
+    free(model->offsets);
+    free(model->totals);
+    free(model->successors);
+    free(model->next_contexts);
+    free(model->counts);
+    free(model->alias_threshold);
+    free(model->alias_index);
+    free(model->start_contexts);
+    model->offsets = NULL;
+    model->totals = NULL;
+    model->successors = NULL;
+    model->next_contexts = NULL;
+    model->counts = NULL;
+    model->alias_threshold = NULL;
+    model->alias_index = NULL;
+    model->start_contexts = NULL;
+    model->num_starts = 0;
+}
+
+/**
+ * Create an empty model
+ */
+NgramModel* new_ngram_model(uint32_t order) {
+    if (order < 1 || order > MAX_NGRAM_ORDER) {
+        return NULL;
+    }
+
+    NgramModel *model = calloc(1, sizeof(NgramModel));
+    if (!model) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+    model->order = order;
+    arena_init(&model->arena, ARENA_DEFAULT_BLOCK_SIZE);
+    if (word_index_init(&model->index, WORD_INDEX_INITIAL_CAPACITY) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(model);
+        return NULL;
+    }
+    return model;
+}
+
+/**
+ * Slide the window over the next word, counting the transition
+ */
+int ngram_model_add_word(NgramModel *model, const char *word, size_t length) {
+    if (!model || !word || length == 0) {
+        return 1;
+    }
+    drop_tables(model);
+
+    uint32_t id;
+    if (word_id(model, word, length, &id) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return 1;
+    }
+
+    if (model->window_size < model->order) {
+        model->window[model->window_size++] = id;
+        return 0;
+    }
+
+    uint32_t context = window_context(model);
+    if (context == NGRAM_NO_CONTEXT ||
+        add_transition(model, context, id) != 0) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return 1;
+    }
+    memmove(model->window, model->window + 1,
+            (model->order - 1) * sizeof(uint32_t));
+    model->window[model->order - 1] = id;
+    return 0;
+}
+
+/**
+ * Group the transitions by context, keeping their first occurrence order
+ */
+int finish_ngram_model(NgramModel *model) {
+    if (!model) {
+        return 1;
+    }
+    drop_tables(model);
+
+    uint32_t n = model->num_contexts;
+    uint32_t e = model->num_transitions;
+    // One extra entry, so that an empty model never does malloc(0)
+    model->offsets = calloc((size_t)n + 1, sizeof(uint32_t));
+    model->totals = calloc((size_t)n + 1, sizeof(uint32_t));
+    model->start_contexts = malloc(((size_t)n + 1) * sizeof(uint32_t));
+    model->successors = malloc(((size_t)e + 1) * sizeof(uint32_t));
+    model->next_contexts = malloc(((size_t)e + 1) * sizeof(uint32_t));
+    model->counts = malloc(((size_t)e + 1) * sizeof(uint32_t));
+    model->alias_threshold = malloc(((size_t)e + 1) * sizeof(uint32_t));
+    model->alias_index = malloc(((size_t)e + 1) * sizeof(uint32_t));
+    uint32_t *cursor = malloc(((size_t)n + 1) * sizeof(uint32_t));
+    if (!model->offsets || !model->totals || !model->start_contexts ||
+        !model->successors || !model->next_contexts || !model->counts ||
+        !model->alias_threshold || !model->alias_index || !cursor) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(cursor);
+        drop_tables(model);
+        return 1;
+    }
+
+    for (uint32_t t = 0; t < e; t++) {
+        model->offsets[model->transitions[t].context + 1]++;
+    }
+    uint32_t max_degree = 0;
+    for (uint32_t c = 0; c < n; c++) {
+        uint32_t degree = model->offsets[c + 1];
+        if (degree > max_degree) {
+            max_degree = degree;
+        }
+        model->offsets[c + 1] = model->offsets[c] + degree;
+        cursor[c] = model->offsets[c];
+    }
+
+    // Each transition also points at the context it leads to
+    uint32_t key[MAX_NGRAM_ORDER];
+    for (uint32_t t = 0; t < e; t++) {
+        const NgramTransition *entry = &model->transitions[t];
+        uint32_t position = cursor[entry->context]++;
+        model->successors[position] = entry->next;
+        model->counts[position] = entry->count;
+        model->totals[entry->context] += entry->count;
+
+        memcpy(key, model->context_words +
+                    (size_t)entry->context * model->order + 1,
+               (model->order - 1) * sizeof(uint32_t));
+        key[model->order - 1] = entry->next;
+        model->next_contexts[position] =
+            find_context(model, key, hash_context(key, model->order));
+    }
+    free(cursor);
+
+    uint64_t *scaled_scratch = malloc((max_degree + 1) * sizeof(uint64_t));
+    uint32_t *index_scratch = malloc((max_degree + 1) * sizeof(uint32_t));
+    if (!scaled_scratch || !index_scratch) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        free(scaled_scratch);
+        free(index_scratch);
+        drop_tables(model);
+        return 1;
+    }
+    for (uint32_t c = 0; c < n; c++) {
+        uint32_t first = model->offsets[c];
+        build_alias_table(model->counts + first, model->offsets[c + 1] - first,
+                          model->alias_threshold + first,
+                          model->alias_index + first,
+                          scaled_scratch, index_scratch);
+    }
+    free(scaled_scratch);
+    free(index_scratch);
+
+    // Every context has a successor, tweets start on the ones that don't
+    // already end a sentence
+    for (uint32_t c = 0; c < n; c++) {
+        const uint32_t *ids = model->context_words + (size_t)c * model->order;
+        bool ends_sentence = false;
+        for (uint32_t i = 0; i < model->order; i++) {
+            ends_sentence = ends_sentence || model->is_last[ids[i]];
+        }
+        if (!ends_sentence) {
+            model->start_contexts[model->num_starts++] = c;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Free the tables, the vocabulary and the model
+ */
+void free_ngram_model(NgramModel **ptr_model) {
+    if (!ptr_model || !(*ptr_model)) {
+        return;
+    }
+    NgramModel *model = *ptr_model;
+    drop_tables(model);
+    free(model->transitions);
+    free(model->transition_slots);
+    free(model->context_words);
+    free(model->context_hashes);
+    free(model->context_slots);
+    free(model->words);
+    free(model->is_last);
+    word_index_destroy(&model->index);
+    arena_free(&model->arena);
+    free(model);
+    *ptr_model = NULL;
+}
+
+/**
+ * Draw from the given stream, or from rand() when there is none
+ */
+static inline uint32_t random_below(Rng *rng, uint32_t bound) {
+    return rng ? rng_below(rng, bound) : (uint32_t)get_random_number((int)bound);
+}
+
+/**
+ * Append the words of a finished tweet
+ */
+static int append_tweet(const NgramModel *model, const uint32_t *ids,
+                        int words, OutputBuffer *out) {
+    for (int i = 0; i < words; i++) {
+        const char *word = model->words[ids[i]];
+        if ((i > 0 && output_buffer_append_char(out, ' ') != 0) ||
+            output_buffer_append(out, word, strlen(word)) != 0) {
+            return 1;
+        }
+    }
+    return output_buffer_append_char(out, '\n');
+}
+
+/**
+ * Walk from a random start context, one alias table draw per word
+ */
+int ngram_generate_tweet(const NgramModel *model, Rng *rng,
+                         OutputBuffer *out, TweetSpan *span) {
+    if (!model || !out || !model->offsets || model->num_starts == 0) {
+        return -1;
+    }
+
+    // Words are only appended once the tweet is known to be valid
+    uint32_t context =
+        model->start_contexts[random_below(rng, model->num_starts)];
+    uint32_t ids[MAX_TWEET_LENGTH];
+    int words = (int)model->order;
+    memcpy(ids, model->context_words + (size_t)context * model->order,
+           model->order * sizeof(uint32_t));
+
+    while (context != NGRAM_NO_CONTEXT) {
+        uint32_t first = model->offsets[context];
+        uint32_t degree = model->offsets[context + 1] - first;
+        uint32_t column = random_below(rng, degree);
+        uint32_t coin = random_below(rng, model->totals[context]);
+        uint32_t t = first + sample_alias_table(model->alias_threshold + first,
+                                                model->alias_index + first,
+                                                column, coin);
+        uint32_t next = model->successors[t];
+        ids[words++] = next;
+
+        // End of sentence or maximal length
+        if (model->is_last[next] || words >= MAX_TWEET_LENGTH) {
+            size_t start = out->length;
+            if (append_tweet(model, ids, words, out) != 0) {
+                printf(ALLOCATION_ERROR_MASSAGE);
+                output_buffer_truncate(out, start);
+                return -1;
+            }
+            if (span) {
+                *span = (TweetSpan) {start, out->length - start};
+            }
+            return words;
+        }
+        context = model->next_contexts[t];
+    }
+
+    // The walk reached the end of the training text
+    return -1;
+}
@@ -0,0 +1,121 @@
+#ifndef _NGRAM_MODEL_H_
+#define _NGRAM_MODEL_H_
+
+#include "markov_chain.h"
+#include "rng.h"
+#include <stdint.h> // For uint32_t
+
+#define MAX_NGRAM_ORDER 8
+#define NGRAM_NO_CONTEXT UINT32_MAX
+
+/**
+ * One observed (context, next word) pair and its number of occurrences.
+ */
+typedef struct NgramTransition {
+    uint32_t context; // context index
+    uint32_t next;    // word id
+    uint32_t count;
+} NgramTransition;
+
+/**
+ * Order-k Markov model: the next word depends on the previous k words.
+ *
+ * Words get dense 32-bit ids. A context is k word ids packed back to back
+ * in context_words, and found through an open addressing table of context
+ * indexes keyed by the hash of those ids. There is no per-context node or
+ * allocation, so memory grows with the number of distinct contexts and
+ * transitions only.
+ *
+ * finish_ngram_model() turns the transitions into CSR arrays with an alias
+ * table per context, and links every transition to the context it leads
+ * to, so generating walks contexts without hashing anything.
+ */
+typedef struct NgramModel {
+    uint32_t order;
+
+    // Vocabulary: word -> id + 1, words and sentence end flags by id
+    WordIndex index;
+    Arena arena;
+    const char **words;
+    uint8_t *is_last;
+    uint32_t num_words;
+    uint32_t words_capacity;
+
+    // Training window: the ids of the last (at most order) words
+    uint32_t window[MAX_NGRAM_ORDER];
+    uint32_t window_size;
+
+    // Contexts: order ids each, table slots hold context index + 1
+    uint32_t *context_words;
+    uint32_t *context_hashes;
+    uint32_t num_contexts;
+    uint32_t contexts_capacity;
+    uint32_t *context_slots;
+    uint32_t context_slots_capacity;
+
+    // Transitions in first occurrence order, same slot scheme
+    NgramTransition *transitions;
+    uint32_t num_transitions;
+    uint32_t transitions_capacity;
+    uint32_t *transition_slots;
+    uint32_t transition_slots_capacity;
+
+    // Sampling tables built by finish_ngram_model(), NULL until then
+    uint32_t *offsets;         // num_contexts + 1 transition offsets
+    uint32_t *totals;          // num_contexts sums of counts
+    uint32_t *successors;      // num_transitions word ids
+    uint32_t *next_contexts;   // num_transitions, NGRAM_NO_CONTEXT if unseen
+    uint32_t *counts;          // num_transitions occurrence counts
+    uint32_t *alias_threshold; // num_transitions, see alias_table.h
+    uint32_t *alias_index;     // num_transitions, relative to the context
+    uint32_t *start_contexts;  // contexts without sentence endings
+    uint32_t num_starts;
+} NgramModel;
+
+/**
+ * Create an empty model.
+ * @param order number of words in a context, 1 to MAX_NGRAM_ORDER
+ * @return the new model, NULL in case of allocation failure or bad order
+ */
+NgramModel* new_ngram_model(uint32_t order);
+
+/**
+ * Feed the next word of the training text. Once order words were seen,
+ * the transition from the previous order words to this one is counted.
+ * Drops the sampling tables of a finished model.
+ * @param model the model
+ * @param word first byte of the word, not necessarily NUL terminated
+ * @param length number of bytes in the word, must be positive
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int ngram_model_add_word(NgramModel *model, const char *word, size_t length);
+
+/**
+ * Build the sampling tables after training.
+ * @param model the model
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int finish_ngram_model(NgramModel *model);
+
+/**
+ * Free the model and everything it holds.
+ * @param ptr_model model to free, set to NULL
+ */
+void free_ngram_model(NgramModel **ptr_model);
+
+/**
+ * Create random sentence using a finished model and append it to an
+ * output buffer, with the same rules as generate_tweet(): the tweet
+ * starts with a random context without sentence endings (uniformly among
+ * those that have successors) and stops after a sentence ending or
+ * MAX_TWEET_LENGTH words. Nothing is appended on failure.
+ * @param model the model
+ * @param rng random stream to draw from, NULL for get_random_number()
+ * @param out buffer to append the tweet (and its newline) to
+ * @param span if not NULL, set to the bytes of the tweet in out
+ * @return Number of words in tweet, -1 on failure
+ */
+int ngram_generate_tweet(const NgramModel *model, Rng *rng,
+                         OutputBuffer *out, TweetSpan *span);
+
+#endif /* _NGRAM_MODEL_H_ */
@@ -0,0 +1,117 @@
+#include "output_buffer.h"
+#include <errno.h>  // For EINTR
+#include <stdlib.h> // For realloc()
+#include <string.h> // For memcpy()
+#include <unistd.h> // For write()
+
+#define OUTPUT_BUFFER_INITIAL_CAPACITY 4096
+
+/**
+ * Initialize an empty buffer
+ */
+void output_buffer_init(OutputBuffer *buffer, int fd, size_t flush_size) {
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->fd = fd;
+    buffer->flush_size = flush_size ? flush_size : OUTPUT_BUFFER_FLUSH_SIZE;
+}
+
+/**
+ * Make room for extra more bytes
+ */
+static int reserve(OutputBuffer *buffer, size_t extra) {
+    if (buffer->capacity - buffer->length >= extra) {
+        return 0;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity :
+                      OUTPUT_BUFFER_INITIAL_CAPACITY;
+    while (capacity - buffer->length < extra) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (!data) {
+        return 1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Append bytes
+ */
+int output_buffer_append(OutputBuffer *buffer, const char *bytes,
+                         size_t length) {
+    if (reserve(buffer, length) != 0) {
+        return 1;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return 0;
+}
+
+/**
+ * Append one byte
+ */
+int output_buffer_append_char(OutputBuffer *buffer, char c) {
+    if (reserve(buffer, 1) != 0) {
+        return 1;
+    }
+    buffer->data[buffer->length++] = c;
+    return 0;
+}
+
+/**
+ * Forget the end of the buffer
+ */
+void output_buffer_truncate(OutputBuffer *buffer, size_t length) {
+    if (length < buffer->length) {
+        buffer->length = length;
+    }
+}
+
+/**
+ * Write everything, retrying partial writes
+ */
+int output_buffer_flush(OutputBuffer *buffer) {
+    if (buffer->fd == OUTPUT_BUFFER_NO_FD) {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < buffer->length) {
+        ssize_t result = write(buffer->fd, buffer->data + written,
+                               buffer->length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        written += (size_t)result;
+    }
+    buffer->length = 0;
+    return 0;
+}
+
+/**
+ * Flush once the buffer is big enough
+ */
+int output_buffer_maybe_flush(OutputBuffer *buffer) {
+    if (buffer->length < buffer->flush_size) {
+        return 0;
+    }
+    return output_buffer_flush(buffer);
+}
+
+/**
+ * Free the memory
+ */
+void output_buffer_free(OutputBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef _OUTPUT_BUFFER_H_
+#define _OUTPUT_BUFFER_H_
+
+#include <stddef.h> // For size_t
+
+#define OUTPUT_BUFFER_FLUSH_SIZE (1 << 16)
+#define OUTPUT_BUFFER_NO_FD (-1)
+
+/**
+ * Growable in-memory output. Text is appended in memory and written to
+ * the file descriptor in large blocks, only when the owner asks for it
+ * (so that a half written tweet can still be taken back).
+ */
+typedef struct OutputBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int fd;                 // where flushes go, OUTPUT_BUFFER_NO_FD if none
+    size_t flush_size;      // output_buffer_maybe_flush() threshold
+} OutputBuffer;
+
+/**
+ * Bytes of one generated tweet inside an OutputBuffer. The span is valid
+ * until the buffer is flushed or truncated before its end.
+ */
+typedef struct TweetSpan {
+    size_t offset;
+    size_t length;
+} TweetSpan;
+
+/**
+ * Initialize an empty buffer.
+ * @param buffer buffer to initialize
+ * @param fd file descriptor flushes write to, OUTPUT_BUFFER_NO_FD to keep
+ * everything in memory
+ * @param flush_size length from which output_buffer_maybe_flush() writes,
+ * 0 for OUTPUT_BUFFER_FLUSH_SIZE
+ */
+void output_buffer_init(OutputBuffer *buffer, int fd, size_t flush_size);
+
+/**
+ * Append bytes at the end of the buffer, growing it geometrically.
+ * @param buffer the buffer
+ * @param bytes bytes to append
+ * @param length number of bytes
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int output_buffer_append(OutputBuffer *buffer, const char *bytes,
+                         size_t length);
+
+/**
+ * Append one byte.
+ * @param buffer the buffer
+ * @param c byte to append
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int output_buffer_append_char(OutputBuffer *buffer, char c);
+
+/**
+ * Drop everything after the first length bytes.
+ * @param buffer the buffer
+ * @param length new length, at most the current one
+ */
+void output_buffer_truncate(OutputBuffer *buffer, size_t length);
+
+/**
+ * Write the whole buffer to its file descriptor and empty it.
+ * @param buffer the buffer
+ * @return 0 on success, 1 if the write failed
+ */
+int output_buffer_flush(OutputBuffer *buffer);
+
+/**
+ * Flush the buffer if it holds at least flush_size bytes.
+ * @param buffer the buffer
+ * @return 0 on success, 1 if the write failed
+ */
+int output_buffer_maybe_flush(OutputBuffer *buffer);
+
+/**
+ * Free the memory of the buffer, without flushing it.
+ * @param buffer the buffer
+ */
+void output_buffer_free(OutputBuffer *buffer);
+
+#endif /* _OUTPUT_BUFFER_H_ */
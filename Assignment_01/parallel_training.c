@@ -0,0 +1,189 @@
+#include "parallel_training.h"
+#include "tokenizer.h"
+#include "markov_stats.h"
+#include <pthread.h>
+
+/**
+ * One contiguous part of the text and the chain trained on it
+ */
+typedef struct TrainingShard {
+    const char *text;
+    size_t size;
+    MarkovChain *chain;      // private chain over the shard
+    MarkovNode *first_word;  // first and last token, in chain
+    MarkovNode *last_word;
+    int failed;
+} TrainingShard;
+
+/**
+ * Thread function: build the private chain of one shard
+ */
+static void* train_shard(void *arg) {
+    TrainingShard *shard = arg;
+    shard->chain = new_markov_chain();
+    if (!shard->chain) {
+        shard->failed = 1;
+        return NULL;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, shard->text, shard->size);
+    const char *token;
+    size_t length;
+    MarkovNode *prev = NULL;
+    StatsTimer timer;
+    stats_timer_start(&timer);
+    while (next_word(&tokenizer, &token, &length)) {
+        stats_timer_lap(&timer, STATS_TOKENIZE);
+        Node *current = add_word_to_database(shard->chain, token, length);
+        stats_timer_lap(&timer, STATS_LOOKUP);
+        if (!current) {
+            shard->failed = 1;
+            break;
+        }
+        MarkovNode *word = (MarkovNode*)current->data;
+        if (prev && add_node_to_frequencies_list(prev, word) != 0) {
+            shard->failed = 1;
+            break;
+        }
+        if (!shard->first_word) {
+            shard->first_word = word;
+        }
+        prev = word;
+        stats_timer_lap(&timer, STATS_INSERT);
+    }
+    stats_timer_lap(&timer, STATS_TOKENIZE);
+    stats_timer_stop(&timer);
+    shard->last_word = prev;
+    return NULL;
+}
+
+/**
+ * Merge one shard into the chain. prev_last is the last word merged so
+ * far (NULL before the first word) and is updated to the shard's last one.
+ */
+static int merge_shard(MarkovChain *chain, TrainingShard *shard,
+                       MarkovNode **prev_last) {
+    LinkedList *database = shard->chain->database;
+    if (database->size == 0) {
+        return 0;
+    }
+
+    StatsTimer timer;
+    stats_timer_start(&timer);
+
+    // Words, in the shard's first occurrence order
+    MarkovNode **merged = malloc(database->size * sizeof(MarkovNode*));
+    if (!merged) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return 1;
+    }
+    for (Node *current = database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *local = (MarkovNode*)current->data;
+        Node *global = add_word_to_database(chain, local->data,
+                                            strlen(local->data));
+        if (!global) {
+            free(merged);
+            return 1;
+        }
+        merged[local->id] = (MarkovNode*)global->data;
+    }
+    stats_timer_lap(&timer, STATS_LOOKUP);
+
+    // The bigram across the boundary comes before any of the shard's
+    if (*prev_last &&
+        add_node_to_frequencies_list(*prev_last,
+                                     merged[shard->first_word->id]) != 0) {
+        free(merged);
+        return 1;
+    }
+
+    // Successors, in the shard's first occurrence order per word
+    for (Node *current = database->first; current != NULL;
+         current = current->next) {
+        MarkovNode *local = (MarkovNode*)current->data;
+        for (int i = 0; i < local->frequency_list_size; i++) {
+            MarkovNodeFrequency *entry = &local->frequency_list[i];
+            if (add_weighted_node_to_frequencies_list(
+                    merged[local->id], merged[entry->markov_node->id],
+                    entry->frequency) != 0) {
+                free(merged);
+                return 1;
+            }
+        }
+    }
+
+    stats_timer_lap(&timer, STATS_INSERT);
+    stats_timer_stop(&timer);
+    *prev_last = merged[shard->last_word->id];
+    free(merged);
+    return 0;
+}
+
+/**
+ * Split, train the shards concurrently, merge them in order
+ */
+MarkovChain* build_markov_chain_parallel(const char *text, size_t size,
+                                         int num_threads) {
+    if (!text || num_threads < 1 || num_threads > MAX_TRAINING_THREADS) {
+        return NULL;
+    }
+
+    TrainingShard shards[MAX_TRAINING_THREADS];
+    pthread_t threads[MAX_TRAINING_THREADS];
+    bool started[MAX_TRAINING_THREADS];
+
+    // Shard boundaries are moved forward to the next delimiter
+    size_t start = 0;
+    for (int i = 0; i < num_threads; i++) {
+        size_t end = (i == num_threads - 1) ? size :
+                     (size_t)((double)size * (i + 1) / num_threads);
+        if (end < start) {
+            end = start;
+        }
+        end = (size_t)(find_delimiter(text + end, text + size) - text);
+        shards[i] = (TrainingShard) {text + start, end - start, NULL, NULL,
+                                     NULL, 0};
+        start = end;
+    }
+
+    // Shard 0 is trained by the calling thread
+    for (int i = 1; i < num_threads; i++) {
+        started[i] = pthread_create(&threads[i], NULL, train_shard,
+                                    &shards[i]) == 0;
+    }
+    train_shard(&shards[0]);
+    for (int i = 1; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            train_shard(&shards[i]);
+        }
+    }
+
+    MarkovChain *chain = NULL;
+    bool failed = false;
+    for (int i = 0; i < num_threads; i++) {
+        failed = failed || shards[i].failed;
+    }
+    if (!failed) {
+        chain = new_markov_chain();
+        failed = !chain;
+    }
+
+    MarkovNode *prev_last = NULL;
+    for (int i = 0; i < num_threads; i++) {
+        if (!failed && merge_shard(chain, &shards[i], &prev_last) != 0) {
+            failed = true;
+        }
+        free_database(&shards[i].chain);
+    }
+
+    if (failed) {
+        free_database(&chain);
+        return NULL;
+    }
+    chain->tail = prev_last;
+    return chain;
+}
@@ -0,0 +1,25 @@
+#ifndef _PARALLEL_TRAINING_H_
+#define _PARALLEL_TRAINING_H_
+
+#include "markov_chain.h"
+
+#define MAX_TRAINING_THREADS 64
+
+/**
+ * Build a markov_chain from a text held in memory, using several threads.
+ *
+ * The text is split into num_threads shards at delimiter boundaries. Each
+ * thread builds a private chain (vocabulary and edge counts) over its
+ * shard, then the shards are merged in order, together with the bigram
+ * that spans each shard boundary. Merging in shard order keeps the first
+ * occurrence order of words and successors, so the result is identical
+ * to a single-threaded build of the same text.
+ * @param text the text, need not be NUL terminated
+ * @param size number of bytes in text
+ * @param num_threads number of shards, between 1 and MAX_TRAINING_THREADS
+ * @return the chain, NULL in case of failure
+ */
+MarkovChain* build_markov_chain_parallel(const char *text, size_t size,
+                                         int num_threads);
+
+#endif /* _PARALLEL_TRAINING_H_ */
@@ -0,0 +1,24 @@
+#include "rng.h"
+
+#define GOLDEN_GAMMA 0x9e3779b97f4a7c15ull
+
+/**
+ * One step of splitmix64, used to spread the seed over the state
+ */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += GOLDEN_GAMMA);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Mix the stream number into the seed, then expand it into the state
+ */
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed;
+    uint64_t mixed = splitmix64(&x) ^ (stream * GOLDEN_GAMMA);
+    for (int i = 0; i < 4; i++) {
+        rng->state[i] = splitmix64(&mixed);
+    }
+}
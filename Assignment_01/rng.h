@@ -0,0 +1,63 @@
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stdint.h> // For uint64_t
+
+/**
+ * xoshiro256** pseudo random generator. Unlike rand() every stream has
+ * its own state, so threads can draw numbers without sharing anything.
+ */
+typedef struct Rng {
+    uint64_t state[4];
+} Rng;
+
+/**
+ * Seed a stream from a seed and a stream number (e.g. a tweet index).
+ * Different stream numbers give independent looking sequences.
+ * @param rng stream to seed
+ * @param seed the user's seed
+ * @param stream stream number
+ */
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream);
+
+/**
+ * Get the next 64 random bits.
+ * @param rng the stream
+ * @return random number
+ */
+static inline uint64_t rng_next(Rng *rng) {
+    uint64_t *s = rng->state;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+/**
+ * Get random number between 0 and bound [0, bound), without modulo bias.
+ * @param rng the stream
+ * @param bound maximal number to return, positive
+ * @return Random number
+ */
+static inline uint32_t rng_below(Rng *rng, uint32_t bound) {
+    // Lemire's multiply and shift, rejecting the few biased products
+    uint64_t product = (rng_next(rng) >> 32) * bound;
+    uint32_t low = (uint32_t)product;
+    if (low < bound) {
+        uint32_t threshold = (uint32_t)-bound % bound;
+        while (low < threshold) {
+            product = (rng_next(rng) >> 32) * bound;
+            low = (uint32_t)product;
+        }
+    }
+    return (uint32_t)(product >> 32);
+}
+
+#endif /* _RNG_H_ */
@@ -0,0 +1,182 @@
+#include "tokenizer.h"
+#include "markov_chain.h" // For DELIMITERS, ALLOCATION_ERROR_MASSAGE
+#include <sys/mman.h>     // For mmap()
+#include <sys/stat.h>     // For fstat()
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#endif
+
+#define READ_CHUNK_SIZE (1 << 20)
+
+// Byte classes for the scalar paths; must match DELIMITERS
+static const bool delimiter_table[256] = {
+        [' '] = true, ['\n'] = true, ['\t'] = true, ['\r'] = true
+};
+
+#ifdef SIMD_WIDTH
+/**
+ * Bit i of the result is set if p[i] is one of DELIMITERS, for the
+ * SIMD_WIDTH bytes at p
+ */
+static inline unsigned int delimiter_mask(const char *p) {
+#if defined(__AVX2__)
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)p);
+    __m256i match = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+    return (unsigned int)_mm256_movemask_epi8(match);
+#else
+    __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+    __m128i match = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')),
+                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+    return (unsigned int)_mm_movemask_epi8(match);
+#endif
+}
+
+#define FULL_MASK ((unsigned int)((1ull << SIMD_WIDTH) - 1))
+#endif
+
+/**
+ * Find the first delimiter, SIMD_WIDTH bytes at a time
+ */
+const char *find_delimiter(const char *pos, const char *end) {
+#ifdef SIMD_WIDTH
+    while (end - pos >= SIMD_WIDTH) {
+        unsigned int mask = delimiter_mask(pos);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += SIMD_WIDTH;
+    }
+#endif
+    while (pos < end && !delimiter_table[(unsigned char)*pos]) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * Find the first non delimiter, SIMD_WIDTH bytes at a time
+ */
+const char *skip_delimiters(const char *pos, const char *end) {
+#ifdef SIMD_WIDTH
+    while (end - pos >= SIMD_WIDTH) {
+        unsigned int mask = ~delimiter_mask(pos) & FULL_MASK;
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += SIMD_WIDTH;
+    }
+#endif
+    while (pos < end && delimiter_table[(unsigned char)*pos]) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * Start at the beginning of the text
+ */
+void tokenizer_init(Tokenizer *tokenizer, const char *text, size_t size) {
+    tokenizer->pos = text;
+    tokenizer->end = text + size;
+}
+
+/**
+ * Skip delimiters, then take everything up to the next one
+ */
+bool next_word(Tokenizer *tokenizer, const char **word, size_t *length) {
+    const char *start = skip_delimiters(tokenizer->pos, tokenizer->end);
+    if (start == tokenizer->end) {
+        tokenizer->pos = start;
+        return false;
+    }
+    const char *stop = find_delimiter(start, tokenizer->end);
+    *word = start;
+    *length = (size_t)(stop - start);
+    tokenizer->pos = stop;
+    return true;
+}
+
+/**
+ * Read a stream that can't be mapped into a growing buffer
+ */
+static int read_stream(FILE *fp, TextSource *source) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t length = 0;
+    char *text = malloc(capacity);
+    if (!text) {
+        printf(ALLOCATION_ERROR_MASSAGE);
+        return 1;
+    }
+
+    size_t bytes_read;
+    while ((bytes_read = fread(text + length, 1, capacity - length, fp)) > 0) {
+        length += bytes_read;
+        if (length == capacity) {
+            char *bigger = realloc(text, capacity * 2);
+            if (!bigger) {
+                printf(ALLOCATION_ERROR_MASSAGE);
+                free(text);
+                return 1;
+            }
+            text = bigger;
+            capacity *= 2;
+        }
+    }
+    if (ferror(fp)) {
+        free(text);
+        return 1;
+    }
+
+    source->buffer = text;
+    source->text = text;
+    source->size = length;
+    return 0;
+}
+
+/**
+ * Map regular files, read anything else
+ */
+int open_text_source(FILE *fp, TextSource *source) {
+    *source = (TextSource) {NULL, 0, NULL, 0, NULL};
+
+    struct stat st;
+    off_t offset = ftello(fp);
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 &&
+        st.st_size > offset) {
+        void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                             fileno(fp), 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, (size_t)st.st_size, MADV_SEQUENTIAL);
+            source->mapping = mapping;
+            source->mapping_size = (size_t)st.st_size;
+            source->text = (const char *)mapping + offset;
+            source->size = (size_t)(st.st_size - offset);
+            return 0;
+        }
+    }
+
+    return read_stream(fp, source);
+}
+
+/**
+ * Release the text
+ */
+void close_text_source(TextSource *source) {
+    if (source->mapping) {
+        munmap(source->mapping, source->mapping_size);
+    }
+    free(source->buffer);
+    *source = (TextSource) {NULL, 0, NULL, 0, NULL};
+}
@@ -0,0 +1,76 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+
+#include <stdbool.h> // for bool
+#include <stddef.h>  // For size_t
+#include <stdio.h>   // For FILE
+
+/**
+ * The whole text of an input stream. Regular files are mapped read-only,
+ * other streams (pipes, terminals) are read into a buffer.
+ */
+typedef struct TextSource {
+    const char *text;
+    size_t size;
+    void *mapping;       // mapped file, or NULL
+    size_t mapping_size;
+    char *buffer;        // malloc'ed copy of a stream that can't be mapped
+} TextSource;
+
+/**
+ * Splits a text into words separated by DELIMITERS. Words are returned as
+ * (pointer, length) views into the text, nothing is copied.
+ */
+typedef struct Tokenizer {
+    const char *pos;
+    const char *end;
+} Tokenizer;
+
+/**
+ * Get the whole text of the stream from its current position.
+ * @param fp stream to read
+ * @param source filled with the text
+ * @return 0 on success, 1 if the stream could not be read
+ */
+int open_text_source(FILE *fp, TextSource *source);
+
+/**
+ * Unmap or free the text of the source.
+ * @param source source to close
+ */
+void close_text_source(TextSource *source);
+
+/**
+ * Start tokenizing a text.
+ * @param tokenizer tokenizer to initialize
+ * @param text the text, need not be NUL terminated
+ * @param size number of bytes in text
+ */
+void tokenizer_init(Tokenizer *tokenizer, const char *text, size_t size);
+
+/**
+ * Get the next word of the text.
+ * @param tokenizer the tokenizer
+ * @param word set to the first byte of the word
+ * @param length set to the number of bytes of the word
+ * @return true if a word was found, false at the end of the text
+ */
+bool next_word(Tokenizer *tokenizer, const char **word, size_t *length);
+
+/**
+ * Find the first delimiter in a range.
+ * @param pos start of the range
+ * @param end end of the range
+ * @return pointer to the delimiter, end if there is none
+ */
+const char *find_delimiter(const char *pos, const char *end);
+
+/**
+ * Find the first byte that is not a delimiter in a range.
+ * @param pos start of the range
+ * @param end end of the range
+ * @return pointer to the byte, end if there is none
+ */
+const char *skip_delimiters(const char *pos, const char *end);
+
+#endif /* _TOKENIZER_H_ */
@@ -1,90 +1,320 @@
 //#define DEBUG
 
 #include "markov_chain.h"
+#include "markov_snapshot.h"
+#include "parallel_training.h"
+#include "batch_generation.h"
+#include "tokenizer.h"
+#include "ngram_model.h"
+#include "compact_chain.h"
+#include "markov_stats.h"
 //include stream for file
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#define MAX_LINE_LENGTH 1000
-#define DELIMITERS " \n\t\r"
 #define FILE_PATH_ERROR "Error: incorrect file path\n"
 #define NUM_ARGS_ERROR "Usage: invalid number of arguments\n"
+#define UNKNOWN_OPTION_ERROR "Usage: unknown option %s\n"
+#define MISSING_VALUE_ERROR "Usage: option %s requires a value\n"
+#define INVALID_VALUE_ERROR "Usage: invalid value for %s\n"
+#define ORDER_CONFLICT_ERROR "Usage: --order can't be combined with %s\n"
+#define MAX_POSITIONAL_ARGS 4
+
+/**
+ * Command line of the generator: the positional arguments
+ * <seed> <tweets_count> <path> [words_to_read] plus --options, which may
+ * appear anywhere.
+ */
+typedef struct GeneratorOptions {
+    unsigned int seed;
+    int tweets_count;
+    char *path;
+    int words_to_read;
+    bool frozen;    // --frozen: sample through alias tables
+    char *save_snapshot; // --save-snapshot PATH: save the frozen model
+    bool from_snapshot;  // --from-snapshot: path is a model snapshot
+    int threads;    // --threads N: train on N shards in parallel, 0 if unset
+    int generate_threads; // --generate-threads N: batch mode, 0 if unset
+    int order;      // --order K: words of context, 1 (the chain) if unset
+    char *append;   // --append PATH: more text to train on, "-" for stdin
+    bool compact;   // --compact: 16-bit counts and alias tables
+    int prune;      // --prune N: drop words and edges seen less than N times
+    bool stats;     // --stats: print engine statistics to stderr
+} GeneratorOptions;
 
 /**
  * Builds a Markov chain from input file
  */
 MarkovChain* build_markov_chain(FILE* fp, int words_to_read) {
+    // Map the file, words are views straight into the mapping
+    TextSource source;
+    if (open_text_source(fp, &source) != 0) {
+        return NULL;
+    }
+
     // Create chain
-    MarkovChain* chain = malloc(sizeof(MarkovChain));
+    MarkovChain* chain = new_markov_chain();
     if (!chain) {
-        printf(ALLOCATION_ERROR_MASSAGE);
+        close_text_source(&source);
         return NULL;
     }
 
-    chain->database = malloc(sizeof(LinkedList));
-    if (!chain->database) {
-        printf(ALLOCATION_ERROR_MASSAGE);
-        free(chain);
+    if (train_markov_chain(chain, source.text, source.size,
+                           words_to_read) < 0) {
+        free_database(&chain);
+    }
+    close_text_source(&source);
+    return chain;
+}
+
+/**
+ * Train an existing chain on the whole of a file, "-" for stdin
+ * @return 0 on success, 1 in case of failure
+ */
+int append_text_file(MarkovChain* chain, const char* path) {
+    bool is_stdin = strcmp(path, "-") == 0;
+    FILE* fp = is_stdin ? stdin : fopen(path, "r");
+    if (!fp) {
+        printf(FILE_PATH_ERROR);
+        return 1;
+    }
+
+    TextSource source;
+    int failed = open_text_source(fp, &source) != 0;
+    if (!failed) {
+        failed = train_markov_chain(chain, source.text, source.size, -1) < 0;
+        close_text_source(&source);
+    }
+    if (!is_stdin) {
+        fclose(fp);
+    }
+    return failed;
+}
+
+/**
+ * Builds an order-k model from input file
+ */
+NgramModel* build_ngram_model(FILE* fp, int words_to_read, int order) {
+    TextSource source;
+    if (open_text_source(fp, &source) != 0) {
         return NULL;
     }
-    chain->database->first = NULL;
-    chain->database->last = NULL;
-    chain->database->size = 0;
 
-    char line[MAX_LINE_LENGTH];
+    NgramModel* model = new_ngram_model((uint32_t)order);
+    if (!model) {
+        close_text_source(&source);
+        return NULL;
+    }
+
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, source.text, source.size);
+    const char* word;
+    size_t length;
     int words_read = 0;
-    Node* prev_node = NULL;
+    while ((words_to_read == -1 || words_read < words_to_read) &&
+           next_word(&tokenizer, &word, &length)) {
+        if (ngram_model_add_word(model, word, length) != 0) {
+            free_ngram_model(&model);
+            close_text_source(&source);
+            return NULL;
+        }
+        words_read++;
+    }
+    close_text_source(&source);
 
-    // Read lines until EOF or word limit reached
-    while (fgets(line, MAX_LINE_LENGTH, fp) != NULL &&
-           (words_to_read == -1 || words_read < words_to_read)) {
+    if (finish_ngram_model(model) != 0) {
+        free_ngram_model(&model);
+    }
+    return model;
+}
 
-        char* word = strtok(line, DELIMITERS);
-        while (word != NULL && (words_to_read == -1 || words_read < words_to_read)) {
-            if (strlen(word) == 0) {
-                word = strtok(NULL, DELIMITERS);
-                continue;
-            }
+/**
+ * Length of the prefix of text holding its first words_to_read words
+ */
+size_t prefix_of_words(const char* text, size_t size, int words_to_read) {
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, text, size);
+    const char* word;
+    size_t length;
+    for (int words = 0; words < words_to_read; words++) {
+        if (!next_word(&tokenizer, &word, &length)) {
+            break;
+        }
+    }
+    return (size_t)(tokenizer.pos - text);
+}
 
-            // Add word to database
-            Node* current = add_to_database(chain, word);
-            if (!current) {
-#ifdef DEBUG
-                printf("Failed to add word: %s\n", word);
-#endif
-                free_database(&chain);
-                return NULL;
-            }
-#ifdef DEBUG
-            printf("Added word: %s\n", word);
-#endif
-            words_read++;
+/**
+ * Build the chain on several threads, from the whole mapped file
+ */
+MarkovChain* build_markov_chain_threaded(FILE* fp, int words_to_read,
+                                         int threads) {
+    TextSource source;
+    if (open_text_source(fp, &source) != 0) {
+        return NULL;
+    }
+    size_t size = source.size;
+    if (words_to_read != -1) {
+        size = prefix_of_words(source.text, size, words_to_read);
+    }
 
-            // Add to frequency list of previous word
-            if (prev_node) {
-                MarkovNode* prev_markov = (MarkovNode*)prev_node->data;
-                MarkovNode* curr_markov = (MarkovNode*)current->data;
-                if (add_node_to_frequencies_list(prev_markov, curr_markov) != 0) {
-#ifdef DEBUG
-                    printf("Failed to add to frequency list: %s -> %s\n",
-                           prev_markov->data, curr_markov->data);
-#endif
-                    free_database(&chain);
-                    return NULL;
-                }
+    MarkovChain* chain = build_markov_chain_parallel(source.text, size,
+                                                     threads);
+    close_text_source(&source);
+    return chain;
+}
+
+/**
+ * Parse the command line into options
+ * @return 0 on success, 1 if the command line is invalid
+ */
+int parse_arguments(int argc, char *argv[], GeneratorOptions *options) {
+    char *positional[MAX_POSITIONAL_ARGS];
+    int positional_count = 0;
+
+    options->frozen = false;
+    options->save_snapshot = NULL;
+    options->from_snapshot = false;
+    options->threads = 0;
+    options->generate_threads = 0;
+    options->order = 1;
+    options->append = NULL;
+    options->compact = false;
+    options->prune = 0;
+    options->stats = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            if (positional_count == MAX_POSITIONAL_ARGS) {
+                printf(NUM_ARGS_ERROR);
+                return 1;
+            }
+            positional[positional_count++] = argv[i];
+        } else if (strcmp(argv[i], "--frozen") == 0) {
+            options->frozen = true;
+        } else if (strcmp(argv[i], "--save-snapshot") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->save_snapshot = argv[++i];
+            options->frozen = true;
+        } else if (strcmp(argv[i], "--from-snapshot") == 0) {
+            options->from_snapshot = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->threads = (int)strtol(argv[++i], NULL, 10);
+            if (options->threads < 1 ||
+                options->threads > MAX_TRAINING_THREADS) {
+                printf(INVALID_VALUE_ERROR, argv[i - 1]);
+                return 1;
             }
+        } else if (strcmp(argv[i], "--generate-threads") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->generate_threads = (int)strtol(argv[++i], NULL, 10);
+            if (options->generate_threads < 1 ||
+                options->generate_threads > MAX_GENERATION_THREADS) {
+                printf(INVALID_VALUE_ERROR, argv[i - 1]);
+                return 1;
+            }
+            options->frozen = true;
+        } else if (strcmp(argv[i], "--append") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->append = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = true;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options->compact = true;
+        } else if (strcmp(argv[i], "--prune") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->prune = (int)strtol(argv[++i], NULL, 10);
+            if (options->prune < 1) {
+                printf(INVALID_VALUE_ERROR, argv[i - 1]);
+                return 1;
+            }
+            options->compact = true;
+        } else if (strcmp(argv[i], "--order") == 0) {
+            if (i + 1 >= argc) {
+                printf(MISSING_VALUE_ERROR, argv[i]);
+                return 1;
+            }
+            options->order = (int)strtol(argv[++i], NULL, 10);
+            if (options->order < 1 || options->order > MAX_NGRAM_ORDER) {
+                printf(INVALID_VALUE_ERROR, argv[i - 1]);
+                return 1;
+            }
+        } else {
+            printf(UNKNOWN_OPTION_ERROR, argv[i]);
+            return 1;
+        }
+    }
 
-            prev_node = current;
-            word = strtok(NULL, DELIMITERS);
+    if (positional_count < 3) {
+        printf(NUM_ARGS_ERROR);
+        return 1;
+    }
+
+    // Higher orders only have the in-memory serial mode
+    if (options->order > 1) {
+        const char *conflict = options->save_snapshot ? "--save-snapshot" :
+                               options->from_snapshot ? "--from-snapshot" :
+                               options->threads ? "--threads" :
+                               options->generate_threads ?
+                               "--generate-threads" :
+                               options->append ? "--append" :
+                               options->compact ? "--compact" :
+                               options->stats ? "--stats" : NULL;
+        if (conflict) {
+            printf(ORDER_CONFLICT_ERROR, conflict);
+            return 1;
         }
     }
 
-#ifdef DEBUG
-    printf("Total words read: %d\n", words_read);
-#endif
-    return chain;
+    options->seed = (int)strtol(positional[0], NULL, 10);
+    options->tweets_count = (int)strtol(positional[1], NULL, 10);
+    options->path = positional[2];
+    options->words_to_read = (positional_count == 4) ?
+                             (int)strtol(positional[3], NULL, 10) : -1;
+    return 0;
+}
+
+/**
+ * Generate one tweet into out, from the order-k model if there is one,
+ * else from the chain or, when chain is NULL, from a loaded snapshot
+ * @return Number of words in tweet, -1 on failure
+ */
+int generate_one_tweet(MarkovChain *chain, const FrozenChain *snapshot,
+                       const NgramModel *ngram, OutputBuffer *out) {
+    if (ngram) {
+        return ngram_generate_tweet(ngram, NULL, out, NULL);
+    }
+    if (!chain) {
+        uint32_t first_id = frozen_chain_random_first(snapshot, NULL);
+        if (first_id == FROZEN_NO_NODE) {
+            return -1;
+        }
+        return frozen_generate_tweet(snapshot, first_id, NULL, out, NULL);
+    }
+
+    MarkovNode* first = get_first_random_node(chain);
+    if (!first || !first->data) {
+        return -1;
+    }
+    return generate_tweet_to_buffer(first, chain, out, NULL);
 }
 
 /**
@@ -102,15 +332,15 @@ int main(int argc, char *argv[]) {
     }
 
     // Parse arguments
-    if (argc <= 3 || argc > 5) {
-        printf(NUM_ARGS_ERROR);
+    GeneratorOptions options;
+    if (parse_arguments(argc, argv, &options) != 0) {
         return EXIT_FAILURE;
     }
 
-    unsigned int seed = (int)strtol(argv[1], NULL, 10);
-    int tweets_count = (int)strtol(argv[2], NULL, 10);
-    char* path = argv[3];
-    int words_to_read = (argv[4] != NULL) ? (int)strtol(argv[4], NULL, 10) : -1;
+    unsigned int seed = options.seed;
+    int tweets_count = options.tweets_count;
+    char* path = options.path;
+    int words_to_read = options.words_to_read;
 
 #ifdef DEBUG
     printf("Arguments parsed: tweets_count=%d, path=%s, words_to_read=%d\n",
@@ -119,72 +349,160 @@ int main(int argc, char *argv[]) {
 
     // Seed random
     srand(seed);
+    markov_stats_enabled = options.stats;
 
-    // Open file
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        printf(FILE_PATH_ERROR);
-        exit(EXIT_FAILURE);
-    }
-#ifdef DEBUG
-    printf("File opened successfully: %s\n", path);
-#endif
+    MarkovChain* chain = NULL;
+    FrozenChain* snapshot = NULL;
+    NgramModel* ngram = NULL;
 
-    // Build chain
-    MarkovChain* chain = build_markov_chain(fp, words_to_read);
-    fclose(fp);
-    if (!chain) {
-        printf("Failed to build Markov chain.\n");
-        exit(EXIT_FAILURE);
-    }
+    if (options.order > 1) {
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            printf(FILE_PATH_ERROR);
+            exit(EXIT_FAILURE);
+        }
+        ngram = build_ngram_model(fp, words_to_read, options.order);
+        fclose(fp);
+        if (!ngram) {
+            printf("Failed to build order-%d model.\n", options.order);
+            exit(EXIT_FAILURE);
+        }
+    } else if (options.from_snapshot && !options.append && !options.compact) {
+        // Map a saved model, nothing to parse or build
+        snapshot = load_markov_snapshot(path);
+        if (!snapshot) {
+            printf("Failed to load model snapshot.\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        if (options.from_snapshot) {
+            // Thaw the saved model to train or compact it, it stays frozen
+            FrozenChain* saved = load_markov_snapshot(path);
+            if (!saved) {
+                printf("Failed to load model snapshot.\n");
+                exit(EXIT_FAILURE);
+            }
+            chain = thaw_frozen_chain(saved);
+            free_frozen_chain(&saved);
+            options.frozen = true;
+        } else {
+            // Open file
+            FILE *fp = fopen(path, "r");
+            if (!fp) {
+                printf(FILE_PATH_ERROR);
+                exit(EXIT_FAILURE);
+            }
 #ifdef DEBUG
-    printf("Markov chain built successfully.\n");
+            printf("File opened successfully: %s\n", path);
 #endif
 
-    // Generate tweets
-    for (int i = 1; i <= tweets_count; i++) {
-        MarkovNode* first = get_first_random_node(chain);
-        if (!first || !first->data) {
+            // Build chain
+            if (options.threads > 0) {
+                chain = build_markov_chain_threaded(fp, words_to_read,
+                                                    options.threads);
+            } else {
+                chain = build_markov_chain(fp, words_to_read);
+            }
+            fclose(fp);
+        }
+        if (!chain) {
+            printf("Failed to build Markov chain.\n");
+            exit(EXIT_FAILURE);
+        }
 #ifdef DEBUG
-            printf("Failed to get valid first node for tweet %d.\n", i);
+        printf("Markov chain built successfully.\n");
 #endif
-            continue;
+
+        // New text continues where the chain's text ended
+        if (options.append && append_text_file(chain, options.append) != 0) {
+            printf("Failed to train on %s.\n", options.append);
+            free_database(&chain);
+            exit(EXIT_FAILURE);
         }
 
-        // Create a temporary file to capture the output
-        FILE* temp = tmpfile();
-        if (!temp) {
-            continue;
+        if (options.compact) {
+            // The compact model replaces the chain, like a loaded snapshot
+            CompactReport report;
+            snapshot = new_compact_frozen_chain(chain,
+                                                (uint32_t)options.prune,
+                                                &report);
+            free_database(&chain);
+            if (!snapshot) {
+                printf("Failed to compact Markov chain.\n");
+                exit(EXIT_FAILURE);
+            }
+            print_compact_report(&report, stderr);
+        } else if (options.frozen && freeze_markov_chain(chain) != 0) {
+            printf("Failed to freeze Markov chain.\n");
+            free_database(&chain);
+            exit(EXIT_FAILURE);
         }
 
-        // Try to generate the tweet
-        int result = generate_tweet(first, chain, temp);
+        if (options.save_snapshot &&
+            save_markov_snapshot(snapshot ? snapshot : chain->frozen,
+                                 options.save_snapshot) != 0) {
+            printf("Failed to save model snapshot.\n");
+            free_database(&chain);
+            free_frozen_chain(&snapshot);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        // If tweet generation was successful
-        if (result > 0) {
-            // Print tweet number and the generated tweet
-            printf("Tweet %d: ", i);
+    // Tweets are gathered in memory and written to stdout in large blocks
+    fflush(stdout);
+    OutputBuffer output;
+    output_buffer_init(&output, STDOUT_FILENO, OUTPUT_BUFFER_FLUSH_SIZE);
+    int failed = 0;
 
-            // Rewind temp file and copy its contents to stdout
-            rewind(temp);
-            char buffer[MAX_LINE_LENGTH];
-            if (fgets(buffer, MAX_LINE_LENGTH, temp) != NULL) {
-                printf("%s", buffer);
+    if (options.generate_threads > 0) {
+        // Batch mode: worker threads share the frozen chain
+        const FrozenChain* frozen = snapshot ? snapshot : chain->frozen;
+        failed = generate_tweets_batch(frozen, seed, tweets_count,
+                                       options.generate_threads, &output);
+    } else {
+        // Generate tweets
+        for (int i = 1; i <= tweets_count && !failed; i++) {
+            // The tweet number is taken back if the tweet fails
+            size_t start = output.length;
+            char prefix[32];
+            int prefix_length = snprintf(prefix, sizeof(prefix),
+                                         "Tweet %d: ", i);
+            if (output_buffer_append(&output, prefix, prefix_length) != 0) {
+                failed = 1;
+                break;
             }
-        }
+
+            int result = generate_one_tweet(chain, snapshot, ngram,
+                                            &output);
+            if (result <= 0) {
+                output_buffer_truncate(&output, start);
 #ifdef DEBUG
-        else {
-            printf("Failed to generate valid tweet %d.\n", i);
-        }
+                printf("Failed to generate valid tweet %d.\n", i);
 #endif
+            }
+            failed = output_buffer_maybe_flush(&output) != 0;
+        }
+    }
 
-        fclose(temp);
+    failed = output_buffer_flush(&output) != 0 || failed;
+    output_buffer_free(&output);
+
+    if (options.stats) {
+        MarkovStats stats;
+        markov_stats_collect(chain, snapshot, &stats);
+        print_markov_stats(&stats, stderr);
     }
 
     // Cleanup
     free_database(&chain);
+    free_frozen_chain(&snapshot);
+    free_ngram_model(&ngram);
 #ifdef DEBUG
     printf("Cleanup done.\n");
 #endif
+    if (failed) {
+        printf("Failed to generate tweets.\n");
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "word_index.h"
+#include <stdlib.h> // For calloc()
+#include <string.h> // For memcmp()
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/**
+ * Hash the given word (FNV-1a, 32 bit)
+ */
+uint32_t hash_word(const char *word, size_t length) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)word[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Round up to the next power of two (at least 2)
+ */
+static size_t round_up_pow2(size_t n) {
+    size_t capacity = 2;
+    while (capacity < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/**
+ * Initialize an empty index
+ */
+int word_index_init(WordIndex *index, size_t initial_capacity) {
+    index->capacity = round_up_pow2(initial_capacity);
+    index->count = 0;
+    index->slots = calloc(index->capacity, sizeof(WordIndexSlot));
+    if (!index->slots) {
+        index->capacity = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Free the slot array
+ */
+void word_index_destroy(WordIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+/**
+ * Find the value stored for the word
+ */
+void *word_index_find(const WordIndex *index, const char *word,
+                      size_t length, uint32_t hash) {
+    if (index->capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const WordIndexSlot *slot = &index->slots[i];
+        if (!slot->word) {
+            return NULL;
+        }
+        if (slot->hash == hash && slot->length == length &&
+            memcmp(slot->word, word, length) == 0) {
+            return slot->value;
+        }
+    }
+}
+
+/**
+ * Place a slot in a table known to have room and not contain its word
+ */
+static void place_slot(WordIndexSlot *slots, size_t capacity,
+                       const WordIndexSlot *slot) {
+    size_t mask = capacity - 1;
+    size_t i = slot->hash & mask;
+    while (slots[i].word) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = *slot;
+}
+
+/**
+ * Double the slot array and rehash every word using the stored hashes
+ */
+static int grow(WordIndex *index) {
+    size_t new_capacity = index->capacity ? index->capacity * 2 : 2;
+    WordIndexSlot *new_slots = calloc(new_capacity, sizeof(WordIndexSlot));
+    if (!new_slots) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->slots[i].word) {
+            place_slot(new_slots, new_capacity, &index->slots[i]);
+        }
+    }
+
+    free(index->slots);
+    index->slots = new_slots;
+    index->capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * Insert a new word, keeping the load factor at most 1/2
+ */
+int word_index_insert(WordIndex *index, const char *word, size_t length,
+                      uint32_t hash, void *value) {
+    if ((index->count + 1) * 2 > index->capacity && grow(index) != 0) {
+        return 1;
+    }
+
+    WordIndexSlot slot = {word, value, hash, (uint32_t)length};
+    place_slot(index->slots, index->capacity, &slot);
+    index->count++;
+    return 0;
+}
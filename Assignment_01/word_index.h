@@ -0,0 +1,78 @@
+#ifndef _WORD_INDEX_H_
+#define _WORD_INDEX_H_
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint32_t
+
+#define WORD_INDEX_INITIAL_CAPACITY 1024
+
+/**
+ * One slot of the open addressing table. An empty slot has word == NULL.
+ * The hash and length are kept next to the pointer so that probing only
+ * touches the key bytes when both already match.
+ */
+typedef struct WordIndexSlot {
+    const char *word;
+    void *value;
+    uint32_t hash;
+    uint32_t length;
+} WordIndexSlot;
+
+/**
+ * Hash table from words to arbitrary values, using linear probing over a
+ * power of two sized slot array. The index does not own the word bytes,
+ * they must stay valid for as long as the index is used.
+ */
+typedef struct WordIndex {
+    WordIndexSlot *slots;
+    size_t capacity;
+    size_t count;
+} WordIndex;
+
+/**
+ * Hash the given word (FNV-1a, 32 bit).
+ * @param word bytes of the word, not necessarily NUL terminated
+ * @param length number of bytes in word
+ * @return the hash of the word
+ */
+uint32_t hash_word(const char *word, size_t length);
+
+/**
+ * Initialize an empty index.
+ * @param index index to initialize
+ * @param initial_capacity expected number of words, rounded up to a power
+ * of two
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int word_index_init(WordIndex *index, size_t initial_capacity);
+
+/**
+ * Free the slot array of the index (not the words or values).
+ * @param index index to destroy
+ */
+void word_index_destroy(WordIndex *index);
+
+/**
+ * Look up a word in the index.
+ * @param index index to look in
+ * @param word bytes of the word
+ * @param length number of bytes in word
+ * @param hash hash_word(word, length)
+ * @return the value stored for the word, NULL if it is not in the index
+ */
+void *word_index_find(const WordIndex *index, const char *word,
+                      size_t length, uint32_t hash);
+
+/**
+ * Insert a word that is not yet in the index, growing it when needed.
+ * @param index index to insert into
+ * @param word bytes of the word, must outlive the index
+ * @param length number of bytes in word
+ * @param hash hash_word(word, length)
+ * @param value value to store, must not be NULL
+ * @return 0 on success, 1 in case of allocation failure
+ */
+int word_index_insert(WordIndex *index, const char *word, size_t length,
+                      uint32_t hash, void *value);
+
+#endif /* _WORD_INDEX_H_ */
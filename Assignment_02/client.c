@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     // For splice() and F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,6 +6,18 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <signal.h>
+#include "http_parser.h"
+#include "latency_histogram.h"
 
 #define MAX_URL_LENGTH 1024
 #define MAX_HOST_LENGTH 256
@@ -12,6 +25,28 @@
 #define MAX_REQUEST_LENGTH 2048
 #define MAX_RESPONSE_LENGTH 65536
 #define MAX_REDIRECTS 5
+#define MAX_POOLED_CONNECTIONS 4
+#define FORWARD_BUFFER_SIZE 65536
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+#define BATCH_CONCURRENCY 100
+#define BATCH_MAX_EVENTS 256
+#define BATCH_IDLE_TIMEOUT_MS 30000
+#define MAX_OUTPUT_PATH_LENGTH 1024
+#define MAX_CACHED_HOSTS 64
+#define BATCH_MAX_WINDOW 64
+#define BATCH_MAX_RETRIES 2
+#define BENCH_CONNECTIONS 10
+#define BENCH_THREADS 2
+#define BENCH_DURATION_SECONDS 10
+#define BENCH_MAX_THREADS 256
+#define MAX_SEGMENTS 64
+#define SEGMENT_MIN_LENGTH (64 * 1024)
+#define SEGMENT_MAX_RETRIES 3
+
+#define USAGE_MESSAGE "Usage: client [-r n < pr1=value1 pr2=value2 ...>] [-o file] <URL>\n" \
+                      "       client -b <list|-> [-c n] [-p n] [-r n < pr1=value1 pr2=value2 ...>] [-o dir]\n" \
+                      "       client --bench [-c connections] [-t threads] [-d seconds | -n requests] [-R rate] <URL>\n" \
+                      "       client -s segments -o file [-r n < pr1=value1 pr2=value2 ...>] <URL>\n"
 
 typedef struct {
     char host[MAX_HOST_LENGTH];
@@ -19,31 +54,198 @@ typedef struct {
     int port;
 } URLComponents;
 
-// Function to extract Location URL from response
-int extract_location_url(char* response, char* location_url, URLComponents* current_components) {
-    char* location_header = strstr(response, "\nLocation: ");
-    if (!location_header) {
-        location_header = strstr(response, "\r\nLocation: ");
-    }
-    if (!location_header) return 0;
+// An open connection to host:port, kept for the next request to the same origin
+typedef struct {
+    char host[MAX_HOST_LENGTH];
+    int port;
+    int sockfd;     // -1 if the slot is free
+} PooledConnection;
 
-    // Move past "Location: "
-    location_header = strchr(location_header, ':') + 2;
+typedef struct {
+    PooledConnection connections[MAX_POOLED_CONNECTIONS];
+    int next_evicted;   // slot to reuse when all of them are taken
+} ConnectionPool;
 
-    // Find end of line
-    char* end_line = strstr(location_header, "\r\n");
-    if (!end_line) {
-        end_line = strchr(location_header, '\n');
-    }
-    if (end_line) *end_line = '\0';
+// Where a response body goes, as it arrives
+typedef struct {
+    int fd;
+    int can_splice;     // move bytes from the socket to fd through a pipe, without copying them
+    int pipe_fds[2];
+    int pipe_size;
+    int failed;         // a write to fd failed
+} BodySink;
 
-    // Remove any leading/trailing whitespace
-    while (*location_header == ' ') location_header++;
-    char* end = location_header + strlen(location_header) - 1;
-    while (end > location_header && (*end == ' ' || *end == '\r' || *end == '\n')) {
-        *end = '\0';
-        end--;
-    }
+// What the parser callbacks of one response share with send_request
+typedef struct {
+    const char* head;           // buffer the status line and headers are read into
+    BodySink* stdout_sink;
+    BodySink* output_sink;
+    BodySink* sink;             // where the body goes, NULL until the headers are in
+    char location[MAX_URL_LENGTH];
+    int redirects_left;
+    int follow;                 // the response is a redirect that will be followed
+} ResponseContext;
+
+// A resolved host name, so that a batch looks each host up once
+typedef struct {
+    char host[MAX_HOST_LENGTH];
+    struct in_addr address;
+    int closes;                 // the server closed a connection after a response: do not pipeline
+} CachedHost;
+
+// Where one URL of a batch is
+typedef enum {
+    FETCH_PENDING,      // waiting for room on a connection to its host
+    FETCH_IN_FLIGHT     // its request is on a connection, the response not complete
+} FetchState;
+
+// One URL of a batch, from its first request to the end of its last redirect
+typedef struct Fetch {
+    FetchState state;
+    int number;                 // of the URL in the list, from 1
+    char url[MAX_URL_LENGTH];
+    char output_path[MAX_OUTPUT_PATH_LENGTH];
+    URLComponents components;
+    BodySink sink;              // fd is -1 until the final response begins
+    char location[MAX_URL_LENGTH];
+    int follow;
+    int redirect_count;
+    int retries;                // requests lost with a connection that never answered
+    long body_bytes;
+    long long started_ms;
+    struct Fetch* next;         // in the pending queue
+} Fetch;
+
+typedef enum {
+    LINK_FREE,
+    LINK_CONNECTING,    // non-blocking connect in progress
+    LINK_OPEN
+} LinkState;
+
+// A keep-alive connection of a batch. Up to window requests are written to it back to
+// back (pipelined); the server answers them in order, so responses go to the fetches
+// from the oldest on.
+typedef struct {
+    LinkState state;
+    int slot;                   // index in the batch
+    char host[MAX_HOST_LENGTH];
+    int port;
+    int sockfd;
+    uint32_t watched;           // epoll events asked for
+    char* output;               // requests not written yet, room for a full window
+    size_t output_length;
+    size_t output_sent;
+    Fetch** in_flight;          // ring of window fetches, oldest first
+    int first;
+    int count;
+    int responses;              // completed on this connection
+    HttpParser parser;          // for the response to in_flight[first]
+    long long active_ms;        // last time the socket made progress
+} BatchConnection;
+
+// State shared by all the fetches and connections of a batch
+typedef struct {
+    int epfd;
+    BatchConnection* connections;
+    int connection_count;
+    int window;                 // requests in flight per connection
+    Fetch* pending_head;
+    Fetch* pending_tail;
+    int pending;
+    int in_flight;
+    const char* output_dir;
+    int param_count;
+    char** params;
+    CachedHost hosts[MAX_CACHED_HOSTS];
+    int host_count;
+    int urls;                   // read from the list so far
+    int succeeded;
+    long total_bytes;
+} Batch;
+
+// What all the threads of a bench share
+typedef struct {
+    struct in_addr address;
+    int port;
+    char request[MAX_REQUEST_LENGTH];
+    size_t request_length;
+    int connections;            // over all threads
+    double rate;                // requests per second over all connections, 0 for as fast as possible
+    long long deadline_ns;      // when to stop, 0 to stop after max_requests
+    long long max_requests;
+    atomic_llong issued;
+} BenchConfig;
+
+typedef enum {
+    BENCH_WAITING,      // for the time of its next request, at a fixed rate
+    BENCH_CONNECTING,
+    BENCH_SENDING,
+    BENCH_RECEIVING,
+    BENCH_STOPPED       // no more requests to send
+} BenchState;
+
+// One connection of a bench, carrying one request at a time
+typedef struct {
+    BenchState state;
+    int index;                  // in its thread
+    int sockfd;                 // -1 between connections
+    uint32_t watched;           // epoll events asked for
+    size_t sent;
+    int reused;                 // the request went on a connection open since an earlier response
+    HttpParser parser;
+    long long intended_ns;      // when the current request was meant to be sent
+    long long due_ns;           // when the next one is, at a fixed rate
+    long long interval_ns;
+} BenchConnection;
+
+typedef struct {
+    BenchConfig* config;
+    pthread_t thread;
+    int epfd;
+    BenchConnection* connections;
+    int connection_count;
+    int first_connection;       // index of connections[0] over all threads
+    LatencyHistogram* histogram;
+    long long completed;
+    long long errors;
+    long long non_2xx;
+    long long bytes;
+} BenchThread;
+
+// What the probe of a segmented download learned from the response to a request for one byte
+typedef struct {
+    int status_code;
+    int accepts_ranges;         // Accept-Ranges: 1 for bytes, 0 for none, -1 if not given
+    long long total_length;     // from Content-Range, -1 if not given
+    char location[MAX_URL_LENGTH];
+} RangeProbe;
+
+// What the threads of a segmented download share
+typedef struct {
+    struct in_addr address;
+    URLComponents components;   // of the final URL, after redirects
+    int param_count;
+    char** params;
+    int fd;                     // the output file, preallocated to its full length
+} SegmentedDownload;
+
+// One byte range of a segmented download, fetched by its own thread over its own connection
+typedef struct {
+    SegmentedDownload* download;
+    pthread_t thread;
+    long long first;            // bytes first to last, inclusive
+    long long last;
+    long long offset;           // of the next byte to write
+    long long range_start;      // first byte of the response, from its Content-Range
+    const char* error;          // NULL once every byte is written
+    long long elapsed_ns;
+} Segment;
+
+// Function to turn the value of a Location header into an absolute URL
+int resolve_location_url(const char* location, char* location_url, URLComponents* current_components) {
+    char location_header[MAX_URL_LENGTH];
+    if (*location == '\0' || strlen(location) >= MAX_URL_LENGTH) return 0;
+    strcpy(location_header, location);
 
     // Check if it's a relative redirect (doesn't start with http://)
     if (strncmp(location_header, "http://", 7) != 0) {
@@ -97,16 +299,13 @@ int extract_location_url(char* response, char* location_url, URLComponents* curr
         // It's an absolute URL
         strcpy(location_url, location_header);
     }
-
-    // If end_line was modified, restore it
-    if (end_line) *end_line = '\r';
     return 1;
 }
 
 // Function to parse URL
 int parse_url(char* url, URLComponents* components) {
     if (strncmp(url, "http://", 7) != 0) {
-        fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+        fprintf(stderr, USAGE_MESSAGE);
         return -1;
     }
 
@@ -126,11 +325,11 @@ int parse_url(char* url, URLComponents* components) {
         char* endptr;
         long port = strtol(port_start, &endptr, 10);
         if (*endptr != '/' && *endptr != '\0') {
-            fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+            fprintf(stderr, USAGE_MESSAGE);
             return -1;
         }
         if (port <= 0 || port >= 65536) {
-            fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+            fprintf(stderr, USAGE_MESSAGE);
             return -1;
         }
         components->port = (int)port;
@@ -144,7 +343,7 @@ int parse_url(char* url, URLComponents* components) {
     // Copy host
     size_t host_len = (path_start ? path_start - host_start : strlen(host_start));
     if (host_len >= MAX_HOST_LENGTH) {
-        fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+        fprintf(stderr, USAGE_MESSAGE);
         return -1;
     }
     strncpy(components->host, host_start, host_len);
@@ -161,8 +360,284 @@ int parse_url(char* url, URLComponents* components) {
     return 0;
 }
 
-// Function to construct HTTP request
-void construct_request(char* request, URLComponents* components, int param_count, char** params) {
+void init_body_sink(BodySink* sink, int fd, int use_splice) {
+    sink->fd = fd;
+    sink->failed = 0;
+    sink->can_splice = use_splice && pipe(sink->pipe_fds) == 0;
+    if (sink->can_splice) {
+        sink->pipe_size = fcntl(sink->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        if (sink->pipe_size <= 0) sink->pipe_size = fcntl(sink->pipe_fds[1], F_GETPIPE_SZ);
+    }
+}
+
+void close_body_sink(BodySink* sink) {
+    if (sink->can_splice) {
+        close(sink->pipe_fds[0]);
+        close(sink->pipe_fds[1]);
+    }
+}
+
+// Function to write all of data to the sink, retrying short writes
+void sink_write(BodySink* sink, const char* data, size_t length) {
+    while (length > 0 && !sink->failed) {
+        ssize_t written = write(sink->fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            sink->failed = 1;
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+// Function to copy the bytes left in the sink's pipe to its fd, once splicing to it failed
+int drain_pipe(BodySink* sink, long length) {
+    char buffer[FORWARD_BUFFER_SIZE];
+    while (length > 0) {
+        ssize_t bytes_read = read(sink->pipe_fds[0], buffer,
+                                  length < FORWARD_BUFFER_SIZE ? length : FORWARD_BUFFER_SIZE);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) {
+            perror("read");
+            return -1;
+        }
+        sink_write(sink, buffer, bytes_read);
+        length -= bytes_read;
+    }
+    return 0;
+}
+
+// Function to move up to wanted bytes from the socket to the sink through its pipe,
+// so that they never get copied to user space. Returns the number of bytes moved,
+// 0 at the end of the stream, -1 on error.
+ssize_t splice_to_sink(int sockfd, BodySink* sink, size_t wanted) {
+    if (wanted > (size_t)sink->pipe_size) wanted = sink->pipe_size;
+
+    ssize_t received;
+    do {
+        received = splice(sockfd, NULL, sink->pipe_fds[1], NULL, wanted, SPLICE_F_MOVE | SPLICE_F_MORE);
+    } while (received < 0 && errno == EINTR);
+    if (received < 0) perror("splice");
+    if (received <= 0) return received;
+
+    ssize_t left = received;
+    while (left > 0) {
+        ssize_t sent = splice(sink->pipe_fds[0], NULL, sink->fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && errno == EINVAL) {
+            // The output does not take spliced data (e.g. a terminal): copy from now on
+            sink->can_splice = 0;
+            return drain_pipe(sink, left) < 0 ? -1 : received;
+        }
+        if (sent < 0) {
+            perror("splice");
+            sink->failed = 1;
+            return -1;
+        }
+        left -= sent;
+    }
+    return received;
+}
+
+// Parser callback: remember where a redirect points to
+int on_response_header(HttpParser* parser, const char* name, const char* value) {
+    ResponseContext* context = parser->data;
+    if (strcasecmp(name, "Location") == 0 && strlen(value) < MAX_URL_LENGTH) {
+        strcpy(context->location, value);
+    }
+    return 0;
+}
+
+// Parser callback: print the status line and headers, and pick where the body goes.
+// Bodies of redirects that are followed are printed, the last one goes to the output.
+int on_response_headers_complete(HttpParser* parser) {
+    ResponseContext* context = parser->data;
+    fwrite(context->head, 1, parser->header_bytes, stdout);
+    fflush(stdout);
+
+    context->follow = parser->status_code >= 300 && parser->status_code < 400 &&  // 3xx status code
+                      context->location[0] != '\0' && context->redirects_left > 0;
+    context->sink = context->follow ? context->stdout_sink : context->output_sink;
+    return 0;
+}
+
+// Parser callback: forward a piece of the body, without its chunk framing
+int on_response_body(HttpParser* parser, const char* data, size_t length) {
+    ResponseContext* context = parser->data;
+    sink_write(context->sink, data, length);
+    return context->sink->failed ? -1 : 0;
+}
+
+const HttpParserCallbacks response_callbacks = {
+    on_response_header,
+    on_response_headers_complete,
+    on_response_body,
+    NULL
+};
+
+// Function to read one response, feeding it to the parser as it arrives. The status line
+// and headers are gathered in response; bodies of known length or that run until close
+// are spliced straight to their sink. Memory use does not depend on the size of the body.
+// Returns the number of bytes read (0 if the peer closed first), -1 on error.
+long receive_response(int sockfd, HttpParser* parser, char* response, ResponseContext* context) {
+    long total = 0;
+    size_t stored = 0;
+
+    while (parser->state != HTTP_MESSAGE_DONE) {
+        long long remaining = http_parser_body_remaining(parser);
+        if (remaining != 0 && context->sink->can_splice) {
+            size_t wanted = context->sink->pipe_size;
+            if (remaining > 0 && remaining < (long long)wanted) wanted = remaining;
+
+            ssize_t moved = splice_to_sink(sockfd, context->sink, wanted);
+            if (moved < 0) return -1;
+            if (moved == 0) {
+                if (http_parser_finish(parser) < 0) {
+                    fprintf(stderr, "%s\n", parser->error);
+                    return -1;
+                }
+                break;
+            }
+            http_parser_skip_body(parser, moved);
+            total += moved;
+            continue;
+        }
+
+        // The headers pile up in response so that they can be printed whole,
+        // body pieces all go to its start
+        char* target = response;
+        size_t space = MAX_RESPONSE_LENGTH;
+        int in_head = parser->state == HTTP_STATUS_LINE || parser->state == HTTP_HEADER_LINE;
+        if (in_head) {
+            if (stored == MAX_RESPONSE_LENGTH) {
+                fprintf(stderr, "Response headers are longer than %d bytes\n", MAX_RESPONSE_LENGTH);
+                return -1;
+            }
+            target = response + stored;
+            space = MAX_RESPONSE_LENGTH - stored;
+        }
+
+        ssize_t bytes_received = read(sockfd, target, space);
+        if (bytes_received < 0) {
+            if (errno == EINTR) continue;
+            // A reset before anything arrived is the peer closing an idle connection
+            if (total == 0 && errno == ECONNRESET) return 0;
+            perror("read");
+            return -1;
+        }
+        if (bytes_received == 0) {
+            if (total == 0) return 0;
+            if (http_parser_finish(parser) < 0) {
+                fprintf(stderr, "%s\n", parser->error);
+                return -1;
+            }
+            break;
+        }
+        total += bytes_received;
+        if (in_head) stored += bytes_received;
+
+        http_parser_execute(parser, target, bytes_received);
+        if (parser->state == HTTP_PARSE_ERROR) {
+            fprintf(stderr, "Invalid response: %s\n", parser->error);
+            return -1;
+        }
+    }
+    return total;
+}
+
+// Function to open a TCP connection to an address, returns the socket or -1 with errno set
+int connect_to_address(struct in_addr address, int port) {
+    // Create socket
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+
+    // Set up server address
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr = address;
+    server_addr.sin_port = htons(port);
+
+    // Connect to server
+    if (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        int error = errno;
+        close(sockfd);
+        errno = error;
+        return -1;
+    }
+    return sockfd;
+}
+
+// Function to open a TCP connection to host:port, returns the socket or -1
+int open_connection(const char* host, int port) {
+    // Get host by name
+    struct hostent* server = gethostbyname(host);
+    if (!server || server->h_addrtype != AF_INET) {
+        herror("gethostbyname");
+        return -1;
+    }
+
+    struct in_addr address;
+    memcpy(&address, server->h_addr, sizeof(struct in_addr));
+    int sockfd = connect_to_address(address, port);
+    if (sockfd < 0) perror("connect");
+    return sockfd;
+}
+
+void init_connection_pool(ConnectionPool* pool) {
+    for (int i = 0; i < MAX_POOLED_CONNECTIONS; i++) {
+        pool->connections[i].sockfd = -1;
+    }
+    pool->next_evicted = 0;
+}
+
+void discard_connection(PooledConnection* connection) {
+    if (connection->sockfd >= 0) close(connection->sockfd);
+    connection->sockfd = -1;
+}
+
+void close_connection_pool(ConnectionPool* pool) {
+    for (int i = 0; i < MAX_POOLED_CONNECTIONS; i++) {
+        discard_connection(&pool->connections[i]);
+    }
+}
+
+// Function to get a connection to the URL's host:port, reusing an open one if there is.
+// *reused tells whether it was already open (and may have been closed by the server since).
+PooledConnection* acquire_connection(ConnectionPool* pool, URLComponents* components, int* reused) {
+    PooledConnection* free_slot = NULL;
+    for (int i = 0; i < MAX_POOLED_CONNECTIONS; i++) {
+        PooledConnection* connection = &pool->connections[i];
+        if (connection->sockfd < 0) {
+            if (!free_slot) free_slot = connection;
+        } else if (connection->port == components->port &&
+                   strcasecmp(connection->host, components->host) == 0) {
+            *reused = 1;
+            return connection;
+        }
+    }
+
+    if (!free_slot) {
+        free_slot = &pool->connections[pool->next_evicted];
+        pool->next_evicted = (pool->next_evicted + 1) % MAX_POOLED_CONNECTIONS;
+        discard_connection(free_slot);
+    }
+
+    int sockfd = open_connection(components->host, components->port);
+    if (sockfd < 0) return NULL;
+
+    strcpy(free_slot->host, components->host);
+    free_slot->port = components->port;
+    free_slot->sockfd = sockfd;
+    *reused = 0;
+    return free_slot;
+}
+
+// Function to construct HTTP request, returns its length.
+// Requests can be built one after another in a buffer to be pipelined.
+int construct_request(char* request, URLComponents* components, int param_count, char** params) {
     char full_path[MAX_PATH_LENGTH];
     strcpy(full_path, components->path);
 
@@ -176,114 +651,1363 @@ void construct_request(char* request, URLComponents* components, int param_count
     }
 
     // Construct the request with proper line endings
-    snprintf(request, MAX_REQUEST_LENGTH,
-             "GET %s HTTP/1.1\r\n"
-             "Host: %s\r\n"
-             "Connection: close\r\n"
-             "\r\n",
-             full_path, components->host);
+    int length = snprintf(request, MAX_REQUEST_LENGTH,
+                          "GET %s HTTP/1.1\r\n"
+                          "Host: %s\r\n"
+                          "Connection: keep-alive\r\n"
+                          "\r\n",
+                          full_path, components->host);
+    return length < MAX_REQUEST_LENGTH ? length : MAX_REQUEST_LENGTH - 1;
+}
+
+// Function to construct a request for the bytes first to last (inclusive) of the URL, returns its length
+int construct_range_request(char* request, URLComponents* components, int param_count, char** params,
+                            long long first, long long last) {
+    // The Range header goes in place of the empty line that ends the request
+    int length = construct_request(request, components, param_count, params) - 2;
+    length += snprintf(request + length, MAX_REQUEST_LENGTH - length,
+                       "Range: bytes=%lld-%lld\r\n"
+                       "\r\n",
+                       first, last);
+    return length < MAX_REQUEST_LENGTH ? length : MAX_REQUEST_LENGTH - 1;
 }
 
-// Function to send HTTP request and handle response
-int send_request(URLComponents* components, int param_count, char** params) {
+// Function to send HTTP request and handle response.
+// The body of the final response goes to output_fd, everything else is printed.
+int send_request(URLComponents* components, int param_count, char** params, int output_fd) {
     int redirect_count = 0;
     char current_url[MAX_URL_LENGTH];
     URLComponents current_components = *components;
     char response[MAX_RESPONSE_LENGTH];
     char request[MAX_REQUEST_LENGTH];
     char location_url[MAX_URL_LENGTH];
+    ConnectionPool pool;
+    BodySink stdout_sink, output_sink;
+    HttpParser parser;
+    ResponseContext context;
+    int result = 0;
+
+    init_connection_pool(&pool);
+    init_body_sink(&stdout_sink, STDOUT_FILENO, 1);
+    init_body_sink(&output_sink, output_fd, 1);
 
     while (1) {
-        // Get host by name
-        struct hostent* server = gethostbyname(current_components.host);
-        if (!server) {
-            herror("gethostbyname");
-            return -1;
+        // Construct the request
+        construct_request(request, &current_components, param_count, params);
+        printf("HTTP request =\n%s\nLEN = %d\n", request, (int)strlen(request));
+
+        // A reused connection may have been closed by the server meanwhile,
+        // in which case the request is sent again on a new one
+        PooledConnection* connection = NULL;
+        long total_bytes = 0;
+        int reused = 1;
+        for (int attempt = 0; attempt < 2 && reused; attempt++) {
+            connection = acquire_connection(&pool, &current_components, &reused);
+            if (!connection) {
+                result = -1;
+                goto done;
+            }
+
+            // Send the request
+            if (write(connection->sockfd, request, strlen(request)) < 0) {
+                if (reused) {
+                    discard_connection(connection);
+                    continue;
+                }
+                perror("write");
+                result = -1;
+                goto done;
+            }
+
+            // Read the response
+            memset(&context, 0, sizeof(context));
+            context.head = response;
+            context.stdout_sink = &stdout_sink;
+            context.output_sink = &output_sink;
+            context.redirects_left = MAX_REDIRECTS - redirect_count;
+            http_parser_init(&parser, &response_callbacks, &context);
+
+            total_bytes = receive_response(connection->sockfd, &parser, response, &context);
+            if (total_bytes < 0 || (total_bytes == 0 && reused)) {
+                discard_connection(connection);
+                if (total_bytes < 0 && !reused) {
+                    result = -1;
+                    goto done;
+                }
+                continue;
+            }
+            break;
+        }
+        if (connection->sockfd < 0) {
+            result = -1;
+            goto done;
         }
+        printf("\nTotal received response bytes: %ld\n", total_bytes);
 
-        // Create socket
-        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            perror("socket");
-            return -1;
+        if (!parser.keep_alive || parser.state != HTTP_MESSAGE_DONE) {
+            discard_connection(connection);
         }
 
-        // Set up server address
-        struct sockaddr_in server_addr;
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-        server_addr.sin_port = htons(current_components.port);
+        // Check for redirect
+        if (context.follow && resolve_location_url(context.location, location_url, &current_components)) {
+            // Parse new URL
+            if (parse_url(location_url, &current_components) == 0) {
+                redirect_count++;
+                continue;
+            }
+        }
 
-        // Connect to server
-        if (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            perror("connect");
-            close(sockfd);
-            return -1;
+        break;
+    }
+
+done:
+    close_connection_pool(&pool);
+    close_body_sink(&stdout_sink);
+    close_body_sink(&output_sink);
+    return result;
+}
+
+long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long now_ms(void) {
+    return now_ns() / 1000000;
+}
+
+// Function to start a non-blocking connect, returns the socket or -1 with errno set.
+// Either way the socket is reported writable once connected (or failed to).
+int start_connect(struct in_addr address, int port) {
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sockfd < 0) return -1;
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr = address;
+    server_addr.sin_port = htons(port);
+
+    if (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS) {
+        int error = errno;
+        close(sockfd);
+        errno = error;
+        return -1;
+    }
+    return sockfd;
+}
+
+// Function to resolve a host name once per batch, NULL if it is unknown
+CachedHost* lookup_host(Batch* batch, const char* host) {
+    for (int i = 0; i < batch->host_count; i++) {
+        if (strcasecmp(batch->hosts[i].host, host) == 0) return &batch->hosts[i];
+    }
+
+    struct hostent* server = gethostbyname(host);
+    if (!server || server->h_addrtype != AF_INET) return NULL;
+
+    // Once full, the last entry is the one replaced
+    CachedHost* cached = &batch->hosts[batch->host_count < MAX_CACHED_HOSTS ? batch->host_count++ :
+                                                                             MAX_CACHED_HOSTS - 1];
+    strcpy(cached->host, host);
+    memcpy(&cached->address, server->h_addr, sizeof(struct in_addr));
+    cached->closes = 0;
+    return cached;
+}
+
+// Parser callback: remember where a redirect points to
+int on_fetch_header(HttpParser* parser, const char* name, const char* value) {
+    Fetch* fetch = parser->data;
+    if (strcasecmp(name, "Location") == 0 && strlen(value) < MAX_URL_LENGTH) {
+        strcpy(fetch->location, value);
+    }
+    return 0;
+}
+
+// Parser callback: open the output file, unless the response is a redirect to follow
+int on_fetch_headers_complete(HttpParser* parser) {
+    Fetch* fetch = parser->data;
+    fetch->follow = parser->status_code >= 300 && parser->status_code < 400 &&
+                    fetch->location[0] != '\0' && fetch->redirect_count < MAX_REDIRECTS;
+    if (fetch->follow) return 0;
+
+    int fd = open(fetch->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(fetch->output_path);
+        return -1;
+    }
+    init_body_sink(&fetch->sink, fd, 0);
+    return 0;
+}
+
+// Parser callback: write a piece of the body to the fetch's file
+int on_fetch_body(HttpParser* parser, const char* data, size_t length) {
+    Fetch* fetch = parser->data;
+    if (fetch->follow) return 0;    // body of a redirect
+    sink_write(&fetch->sink, data, length);
+    fetch->body_bytes += length;
+    return fetch->sink.failed ? -1 : 0;
+}
+
+const HttpParserCallbacks fetch_callbacks = {
+    on_fetch_header,
+    on_fetch_headers_complete,
+    on_fetch_body,
+    NULL
+};
+
+// Function to close the output file of a fetch, returns -1 if that failed
+int close_fetch_output(Fetch* fetch) {
+    int result = 0;
+    if (fetch->sink.fd >= 0) result = close(fetch->sink.fd);
+    fetch->sink.fd = -1;
+    return result;
+}
+
+// Function to end a fetch and report it. error is NULL on success.
+void finish_fetch(Batch* batch, Fetch* fetch, int status_code, const char* error) {
+    if (close_fetch_output(fetch) < 0 && !error) error = strerror(errno);
+
+    if (error) {
+        printf("FAILED %s: %s\n", fetch->url, error);
+    } else {
+        printf("%d %ld bytes %lld ms %s -> %s\n", status_code, fetch->body_bytes,
+               now_ms() - fetch->started_ms, fetch->url, fetch->output_path);
+        batch->succeeded++;
+        batch->total_bytes += fetch->body_bytes;
+    }
+    free(fetch);
+}
+
+void queue_fetch(Batch* batch, Fetch* fetch) {
+    fetch->state = FETCH_PENDING;
+    fetch->next = NULL;
+    if (batch->pending_tail) batch->pending_tail->next = fetch;
+    else batch->pending_head = fetch;
+    batch->pending_tail = fetch;
+    batch->pending++;
+}
+
+// Function to start the fetch of one line of the list: "URL [file]".
+// The body is saved as file, or as <number>.out, in the output directory.
+void begin_fetch(Batch* batch, char* line) {
+    char* url = strtok(line, " \t\r\n");
+    char* file = strtok(NULL, " \t\r\n");
+
+    Fetch* fetch = calloc(1, sizeof(Fetch));
+    if (!fetch) {
+        perror("calloc");
+        return;
+    }
+    fetch->sink.fd = -1;
+    fetch->number = ++batch->urls;
+    fetch->started_ms = now_ms();
+    snprintf(fetch->url, sizeof(fetch->url), "%s", url);
+    if (file) {
+        snprintf(fetch->output_path, sizeof(fetch->output_path), "%s/%s", batch->output_dir, file);
+    } else {
+        snprintf(fetch->output_path, sizeof(fetch->output_path), "%s/%d.out", batch->output_dir, fetch->number);
+    }
+
+    // parse_url writes into the URL it is given
+    char url_copy[MAX_URL_LENGTH];
+    strcpy(url_copy, fetch->url);
+    if (strlen(url) >= MAX_URL_LENGTH || parse_url(url_copy, &fetch->components) != 0) {
+        finish_fetch(batch, fetch, 0, "invalid URL");
+        return;
+    }
+    queue_fetch(batch, fetch);
+}
+
+// Function to set the epoll events of a connection's socket
+void watch_batch_connection(Batch* batch, BatchConnection* connection, uint32_t events) {
+    if (connection->watched == events) return;
+    // Events name the slot and the socket, so that none is taken for a later socket of the slot
+    struct epoll_event event = {.events = events,
+                                .data.u64 = (uint64_t)connection->slot << 32 | connection->sockfd};
+    epoll_ctl(batch->epfd, connection->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection->sockfd, &event);
+    connection->watched = events;
+}
+
+// Function to close a connection. The fetches still on it are queued again to be sent on
+// another one, unless error is not NULL or they were already retried too often, in which
+// case they fail. A server that answered a request before closing did not lose the others,
+// it only declined to answer them there, so they are not counted as retries then.
+void close_batch_connection(Batch* batch, BatchConnection* connection, const char* error) {
+    if (connection->state == LINK_FREE) return;
+    close(connection->sockfd);  // which also takes it out of the epoll set
+
+    for (int i = 0; i < connection->count; i++) {
+        Fetch* fetch = connection->in_flight[(connection->first + i) % batch->window];
+        batch->in_flight--;
+        close_fetch_output(fetch);
+        fetch->body_bytes = 0;
+        if (connection->responses == 0) fetch->retries++;
+        if (error || fetch->retries > BATCH_MAX_RETRIES) {
+            finish_fetch(batch, fetch, 0, error ? error : "connection closed");
+        } else {
+            queue_fetch(batch, fetch);
         }
+    }
 
-        // Construct and send request
-        construct_request(request, &current_components, param_count, params);
-        printf("HTTP request =\n%s\nLEN = %d\n", request, (int)strlen(request));
+    connection->state = LINK_FREE;
+    connection->sockfd = -1;
+    connection->watched = 0;
+    connection->count = 0;
+    connection->first = 0;
+    connection->output_length = 0;
+    connection->output_sent = 0;
+}
 
-        // Send the request
-        if (write(sockfd, request, strlen(request)) < 0) {
-            perror("write");
-            close(sockfd);
-            return -1;
+// Function to connect a free slot to the fetch's host. Returns 0, or -1 with the reason in *error.
+int open_batch_connection(Batch* batch, BatchConnection* connection, Fetch* fetch, const char** error) {
+    CachedHost* host = lookup_host(batch, fetch->components.host);
+    if (!host) {
+        *error = "host not found";
+        return -1;
+    }
+    connection->sockfd = start_connect(host->address, fetch->components.port);
+    if (connection->sockfd < 0) {
+        *error = strerror(errno);
+        return -1;
+    }
+
+    strcpy(connection->host, fetch->components.host);
+    connection->port = fetch->components.port;
+    connection->state = LINK_CONNECTING;
+    connection->responses = 0;
+    connection->active_ms = now_ms();
+    watch_batch_connection(batch, connection, EPOLLOUT);
+    return 0;
+}
+
+// Function to put a fetch's request behind the others on a connection
+void assign_fetch(Batch* batch, BatchConnection* connection, Fetch* fetch) {
+    // Make room at the end of the output buffer
+    if (connection->output_sent > 0) {
+        memmove(connection->output, connection->output + connection->output_sent,
+                connection->output_length - connection->output_sent);
+        connection->output_length -= connection->output_sent;
+        connection->output_sent = 0;
+    }
+    connection->output_length += construct_request(connection->output + connection->output_length,
+                                                   &fetch->components, batch->param_count, batch->params);
+
+    fetch->state = FETCH_IN_FLIGHT;
+    fetch->location[0] = '\0';
+    fetch->follow = 0;
+    connection->in_flight[(connection->first + connection->count) % batch->window] = fetch;
+    if (connection->count++ == 0) {
+        http_parser_init(&connection->parser, &fetch_callbacks, fetch);
+        connection->active_ms = now_ms();
+    }
+    batch->in_flight++;
+
+    if (connection->state == LINK_OPEN) watch_batch_connection(batch, connection, EPOLLIN | EPOLLOUT);
+}
+
+// Function to give pending fetches to connections: one to their host with room in its window,
+// else a free slot, else an idle connection to another host. The others keep waiting.
+void dispatch_pending(Batch* batch) {
+    Fetch* previous = NULL;
+    Fetch* fetch = batch->pending_head;
+    while (fetch) {
+        Fetch* next = fetch->next;
+        CachedHost* host = NULL;
+        for (int i = 0; i < batch->host_count; i++) {
+            if (strcasecmp(batch->hosts[i].host, fetch->components.host) == 0) host = &batch->hosts[i];
+        }
+        int window = host && host->closes ? 1 : batch->window;
+
+        BatchConnection* chosen = NULL;
+        BatchConnection* free_slot = NULL;
+        BatchConnection* idle = NULL;
+        for (int i = 0; i < batch->connection_count && !chosen; i++) {
+            BatchConnection* connection = &batch->connections[i];
+            if (connection->state == LINK_FREE) {
+                if (!free_slot) free_slot = connection;
+            } else if (connection->port == fetch->components.port &&
+                       strcasecmp(connection->host, fetch->components.host) == 0) {
+                if (connection->count < window) chosen = connection;
+            } else if (connection->count == 0 && !idle) {
+                idle = connection;
+            }
+        }
+        if (!chosen && !free_slot && idle) {
+            close_batch_connection(batch, idle, NULL);
+            free_slot = idle;
         }
 
-        // Read the response
-        memset(response, 0, MAX_RESPONSE_LENGTH);
-        int total_bytes = 0;
-        int bytes_received;
+        const char* error = NULL;
+        if (!chosen && free_slot && open_batch_connection(batch, free_slot, fetch, &error) == 0) {
+            chosen = free_slot;
+        }
+        if (chosen || error) {
+            // Out of the pending queue
+            if (previous) previous->next = next;
+            else batch->pending_head = next;
+            if (batch->pending_tail == fetch) batch->pending_tail = previous;
+            batch->pending--;
 
-        while ((bytes_received = read(sockfd, response + total_bytes,
-                                      MAX_RESPONSE_LENGTH - total_bytes - 1)) > 0) {
-            total_bytes += bytes_received;
+            if (chosen) assign_fetch(batch, chosen, fetch);
+            else finish_fetch(batch, fetch, 0, error);
+        } else {
+            previous = fetch;
         }
+        fetch = next;
+    }
+}
+
+// Function to end the response to the oldest request on a connection: report it,
+// or queue it again for the URL it redirects to
+void complete_fetch(Batch* batch, BatchConnection* connection) {
+    Fetch* fetch = connection->in_flight[connection->first];
+    connection->first = (connection->first + 1) % batch->window;
+    connection->count--;
+    connection->responses++;
+    batch->in_flight--;
+
+    if (!connection->parser.keep_alive) {
+        CachedHost* host = lookup_host(batch, connection->host);
+        if (host) host->closes = 1;
+    }
 
+    if (fetch->follow) {
+        // Redirect: start over with the new URL, on whatever connection suits it
+        char location_url[MAX_URL_LENGTH];
+        fetch->redirect_count++;
+        if (resolve_location_url(fetch->location, location_url, &fetch->components) &&
+            parse_url(location_url, &fetch->components) == 0) {
+            queue_fetch(batch, fetch);
+        } else {
+            finish_fetch(batch, fetch, 0, "invalid redirect");
+        }
+    } else {
+        finish_fetch(batch, fetch, connection->parser.status_code, NULL);
+    }
+
+    if (connection->count > 0) {
+        http_parser_init(&connection->parser, &fetch_callbacks, connection->in_flight[connection->first]);
+    }
+}
+
+// Function to go on with a connection whose socket is ready: connect, write the queued
+// requests, and parse the responses, several of which may come in one read
+void advance_batch_connection(Batch* batch, BatchConnection* connection, uint32_t events) {
+    char buffer[FORWARD_BUFFER_SIZE];
+    connection->active_ms = now_ms();
+
+    if (connection->state == LINK_CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(connection->sockfd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) error = errno;
+        if (error) {
+            close_batch_connection(batch, connection, strerror(error));
+            return;
+        }
+        connection->state = LINK_OPEN;
+        events |= EPOLLOUT;
+    }
+
+    if (events & EPOLLOUT) {
+        while (connection->output_sent < connection->output_length) {
+            ssize_t sent = write(connection->sockfd, connection->output + connection->output_sent,
+                                 connection->output_length - connection->output_sent);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                close_batch_connection(batch, connection, NULL);
+                return;
+            }
+            connection->output_sent += sent;
+        }
+        int unsent = connection->output_sent < connection->output_length;
+        watch_batch_connection(batch, connection, EPOLLIN | (unsent ? EPOLLOUT : 0));
+    }
+
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+
+    while (1) {
+        ssize_t bytes_received = read(connection->sockfd, buffer, sizeof(buffer));
         if (bytes_received < 0) {
-            perror("read");
-            close(sockfd);
-            return -1;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+            close_batch_connection(batch, connection, NULL);
+            return;
+        }
+        if (bytes_received == 0) {
+            // A body that runs until close is complete now, the requests after it are not answered
+            if (connection->count > 0 && connection->parser.state == HTTP_BODY_UNTIL_CLOSE &&
+                http_parser_finish(&connection->parser) == 0) {
+                complete_fetch(batch, connection);
+            }
+            close_batch_connection(batch, connection, NULL);
+            return;
         }
 
-        response[total_bytes] = '\0';
-        for (int i = 0; i < total_bytes; ++i) {
-            putchar(response[i]);
+        // Each response ends where the parser stops; what follows is the next one
+        size_t offset = 0;
+        while (offset < (size_t)bytes_received) {
+            if (connection->count == 0) {
+                close_batch_connection(batch, connection, NULL);   // bytes nobody asked for
+                return;
+            }
+            offset += http_parser_execute(&connection->parser, buffer + offset, bytes_received - offset);
+            if (connection->parser.state == HTTP_PARSE_ERROR) {
+                Fetch* fetch = connection->in_flight[connection->first];
+                connection->first = (connection->first + 1) % batch->window;
+                connection->count--;
+                batch->in_flight--;
+                finish_fetch(batch, fetch, 0, connection->parser.error);
+                close_batch_connection(batch, connection, NULL);
+                return;
+            }
+            if (connection->parser.state == HTTP_MESSAGE_DONE) {
+                int keep_alive = connection->parser.keep_alive;
+                complete_fetch(batch, connection);
+                if (!keep_alive) {
+                    close_batch_connection(batch, connection, NULL);
+                    return;
+                }
+            }
         }
-        printf("\nTotal received response bytes: %d\n", total_bytes);
+    }
+}
 
-        // Check for redirect
-        if (strncmp(response + 9, "3", 1) == 0) {  // 3xx status code
-            if (extract_location_url(response, location_url, &current_components)) {
-                // Parse new URL
-                if (parse_url(location_url, &current_components) == 0) {
-                    redirect_count++;
-                    close(sockfd);
-                    continue;
+// Function to fetch every URL of the list from one epoll loop, over up to connection_count
+// keep-alive connections carrying up to window pipelined requests each.
+// Returns 0 if they all succeeded, -1 otherwise.
+int run_batch(FILE* list, const char* output_dir, int connection_count, int window,
+              int param_count, char** params) {
+    Batch batch;
+    memset(&batch, 0, sizeof(Batch));
+    batch.output_dir = output_dir;
+    batch.connection_count = connection_count;
+    batch.window = window;
+    batch.param_count = param_count;
+    batch.params = params;
+
+    batch.epfd = epoll_create1(0);
+    batch.connections = calloc(connection_count, sizeof(BatchConnection));
+    if (batch.epfd < 0 || !batch.connections) {
+        perror("batch");
+        if (batch.epfd >= 0) close(batch.epfd);
+        free(batch.connections);
+        return -1;
+    }
+    int ready_connections = 0;
+    for (; ready_connections < connection_count; ready_connections++) {
+        BatchConnection* connection = &batch.connections[ready_connections];
+        connection->slot = ready_connections;
+        connection->sockfd = -1;
+        connection->output = malloc((size_t)window * MAX_REQUEST_LENGTH);
+        connection->in_flight = malloc(window * sizeof(Fetch*));
+        if (!connection->output || !connection->in_flight) {
+            free(connection->output);
+            free(connection->in_flight);
+            break;
+        }
+    }
+
+    long long started_ms = now_ms();
+    char line[MAX_URL_LENGTH + MAX_OUTPUT_PATH_LENGTH];
+    int list_done = ready_connections < connection_count;
+    if (list_done) perror("malloc");
+    struct epoll_event events[BATCH_MAX_EVENTS];
+
+    while (1) {
+        // Read ahead as many URLs as the connections can carry
+        while (!list_done && batch.pending + batch.in_flight < connection_count * window) {
+            if (!fgets(line, sizeof(line), list)) {
+                list_done = 1;
+                break;
+            }
+            char* start = line + strspn(line, " \t\r\n");
+            if (!strchr(line, '\n') && !feof(list)) {
+                // Longer than the buffer: the rest of the line is skipped, not taken for another URL
+                int c;
+                while ((c = fgetc(list)) != EOF && c != '\n');
+                if (*start == '#') continue;
+                batch.urls++;
+                printf("FAILED %.64s...: line too long\n", start);
+                continue;
+            }
+            if (*start == '\0' || *start == '#') continue;   // blank lines and comments
+            begin_fetch(&batch, start);
+        }
+        dispatch_pending(&batch);
+        if (batch.in_flight == 0 && batch.pending == 0 && list_done) break;
+
+        int ready = epoll_wait(batch.epfd, events, BATCH_MAX_EVENTS, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            BatchConnection* connection = &batch.connections[events[i].data.u64 >> 32];
+            int sockfd = (int)(events[i].data.u64 & 0xffffffff);
+            if (connection->state != LINK_FREE && connection->sockfd == sockfd) {
+                advance_batch_connection(&batch, connection, events[i].events);
+            }
+        }
+
+        // Give up on requests whose server went quiet
+        long long now = now_ms();
+        for (int i = 0; i < ready_connections; i++) {
+            BatchConnection* connection = &batch.connections[i];
+            if (connection->state != LINK_FREE && connection->count > 0 &&
+                now - connection->active_ms > BATCH_IDLE_TIMEOUT_MS) {
+                close_batch_connection(&batch, connection, "timed out");
+            }
+        }
+    }
+
+    double seconds = (now_ms() - started_ms) / 1000.0;
+    printf("Fetched %d of %d URLs, %ld bytes in %.3f s\n",
+           batch.succeeded, batch.urls, batch.total_bytes, seconds);
+
+    for (int i = 0; i < ready_connections; i++) {
+        close_batch_connection(&batch, &batch.connections[i], "aborted");
+        free(batch.connections[i].output);
+        free(batch.connections[i].in_flight);
+    }
+    while (batch.pending_head) {
+        Fetch* fetch = batch.pending_head;
+        batch.pending_head = fetch->next;
+        finish_fetch(&batch, fetch, 0, "aborted");
+    }
+    close(batch.epfd);
+    free(batch.connections);
+    return batch.succeeded == batch.urls ? 0 : -1;
+}
+
+// Function to take one request from the bench's budget, 0 if it is spent
+int bench_claim_request(BenchConfig* config, long long now) {
+    if (config->deadline_ns && now >= config->deadline_ns) return 0;
+    if (config->max_requests) {
+        return atomic_fetch_add_explicit(&config->issued, 1, memory_order_relaxed) < config->max_requests;
+    }
+    return 1;
+}
+
+// Function to set the epoll events of a connection's socket, adding it on the first call
+int bench_watch(BenchThread* thread, BenchConnection* connection, uint32_t events, int add) {
+    if (!add && connection->watched == events) return 0;
+    struct epoll_event event = {.events = events,
+                                .data.u64 = (uint64_t)connection->index << 32 | connection->sockfd};
+    connection->watched = events;
+    return epoll_ctl(thread->epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection->sockfd, &event);
+}
+
+void bench_close(BenchConnection* connection) {
+    if (connection->sockfd >= 0) {
+        close(connection->sockfd);  // which also takes it out of the epoll set
+        connection->sockfd = -1;
+    }
+}
+
+// Function to count a failed request and leave the next one to the thread's loop,
+// which also keeps a server that refuses connections from being retried recursively
+void bench_fail(BenchThread* thread, BenchConnection* connection) {
+    thread->errors++;
+    bench_close(connection);
+    if (thread->config->rate <= 0) connection->due_ns = now_ns();
+    connection->state = BENCH_WAITING;
+}
+
+// Function to start a new connection for the current request
+void bench_connect(BenchThread* thread, BenchConnection* connection) {
+    BenchConfig* config = thread->config;
+    connection->sent = 0;
+    connection->reused = 0;
+    connection->sockfd = start_connect(config->address, config->port);
+    if (connection->sockfd < 0 || bench_watch(thread, connection, EPOLLOUT, 1) < 0) {
+        bench_fail(thread, connection);
+        return;
+    }
+    connection->state = BENCH_CONNECTING;
+}
+
+// Function to handle a connection that broke before any of the response came. A kept alive
+// connection may have been closed by the server while idle: the request is sent again on a
+// new one, its latency still counted from when it was meant to be sent. On a new connection
+// it is an error.
+void bench_fail_unanswered(BenchThread* thread, BenchConnection* connection) {
+    if (!connection->reused) {
+        bench_fail(thread, connection);
+        return;
+    }
+    bench_close(connection);
+    bench_connect(thread, connection);
+}
+
+// Function to write the request, as far as the socket takes it
+void bench_send(BenchThread* thread, BenchConnection* connection) {
+    BenchConfig* config = thread->config;
+    while (connection->sent < config->request_length) {
+        ssize_t sent = write(connection->sockfd, config->request + connection->sent,
+                             config->request_length - connection->sent);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (bench_watch(thread, connection, EPOLLOUT, 0) < 0) bench_fail(thread, connection);
+                return;
+            }
+            if (errno == EINTR) continue;
+            bench_fail_unanswered(thread, connection);
+            return;
+        }
+        connection->sent += sent;
+    }
+    http_parser_init(&connection->parser, NULL, NULL);
+    connection->state = BENCH_RECEIVING;
+    if (bench_watch(thread, connection, EPOLLIN, 0) < 0) bench_fail(thread, connection);
+}
+
+// Function to send a request on the connection, connecting first if needed.
+// At a fixed rate the request is due at due_ns, and its latency counts from then
+// even if it is sent later: a slow server does not get to slow down the load.
+void bench_issue(BenchThread* thread, BenchConnection* connection, long long now) {
+    BenchConfig* config = thread->config;
+    if (!bench_claim_request(config, now)) {
+        bench_close(connection);
+        connection->state = BENCH_STOPPED;
+        return;
+    }
+
+    connection->intended_ns = now;
+    if (config->rate > 0) {
+        connection->intended_ns = connection->due_ns;
+        connection->due_ns += connection->interval_ns;
+    }
+    if (connection->sockfd < 0) {
+        bench_connect(thread, connection);
+        return;
+    }
+    connection->sent = 0;
+    connection->reused = 1;
+    connection->state = BENCH_SENDING;
+    bench_send(thread, connection);
+}
+
+// Function to go on after a request: right away, or when the next one is due
+void bench_next(BenchThread* thread, BenchConnection* connection, long long now) {
+    if (thread->config->rate > 0) {
+        connection->state = BENCH_WAITING;
+    } else {
+        bench_issue(thread, connection, now);
+    }
+}
+
+// Function to go on with a connection whose socket is ready
+void bench_advance(BenchThread* thread, BenchConnection* connection) {
+    char buffer[FORWARD_BUFFER_SIZE];
+
+    // Nothing is expected between requests: the server closed the idle connection
+    // (or sent bytes nobody asked for). Left open, its end would be reported on every wait.
+    if (connection->state == BENCH_WAITING) {
+        bench_close(connection);
+        return;
+    }
+
+    if (connection->state == BENCH_CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(connection->sockfd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error) {
+            bench_fail(thread, connection);
+            return;
+        }
+        connection->state = BENCH_SENDING;
+    }
+    if (connection->state == BENCH_SENDING) {
+        bench_send(thread, connection);
+        return;
+    }
+    if (connection->state != BENCH_RECEIVING) return;
+
+    while (connection->parser.state != HTTP_MESSAGE_DONE) {
+        ssize_t bytes_received = read(connection->sockfd, buffer, sizeof(buffer));
+        int unanswered = connection->parser.state == HTTP_STATUS_LINE &&
+                         connection->parser.header_bytes == 0 && connection->parser.line_length == 0;
+        if (bytes_received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+            if (unanswered) bench_fail_unanswered(thread, connection);
+            else bench_fail(thread, connection);
+            return;
+        }
+        if (bytes_received == 0) {
+            if (unanswered) {
+                bench_fail_unanswered(thread, connection);
+                return;
+            }
+            if (http_parser_finish(&connection->parser) < 0) {
+                bench_fail(thread, connection);
+                return;
+            }
+            break;
+        }
+        thread->bytes += bytes_received;
+
+        size_t used = http_parser_execute(&connection->parser, buffer, bytes_received);
+        if (connection->parser.state == HTTP_PARSE_ERROR ||
+            (connection->parser.state == HTTP_MESSAGE_DONE && used < (size_t)bytes_received)) {
+            // Bytes after the response to the only request in flight
+            bench_fail(thread, connection);
+            return;
+        }
+    }
+
+    long long now = now_ns();
+    latency_histogram_record(thread->histogram, now - connection->intended_ns);
+    thread->completed++;
+    if (connection->parser.status_code < 200 || connection->parser.status_code >= 300) thread->non_2xx++;
+    if (!connection->parser.keep_alive) bench_close(connection);
+    bench_next(thread, connection, now);
+}
+
+// Function run by each bench thread: its own connections, from its own epoll loop
+void* bench_thread_main(void* arg) {
+    BenchThread* thread = arg;
+    BenchConfig* config = thread->config;
+    struct epoll_event events[BATCH_MAX_EVENTS];
+    long long start = now_ns();
+
+    for (int i = 0; i < thread->connection_count; i++) {
+        BenchConnection* connection = &thread->connections[i];
+        connection->index = i;
+        connection->sockfd = -1;
+        if (config->rate > 0) {
+            // Each connection gets an equal share of the rate, with the connections
+            // spread evenly over the interval rather than all starting at once
+            connection->interval_ns = (long long)(config->connections / config->rate * 1e9);
+            connection->due_ns = start + connection->interval_ns * (thread->first_connection + i) /
+                                         config->connections;
+            connection->state = BENCH_WAITING;
+        } else {
+            bench_issue(thread, connection, start);
+        }
+    }
+
+    while (1) {
+        long long now = now_ns();
+        if (config->deadline_ns && now >= config->deadline_ns) break;
+
+        // Send what is due, and find out how long until the next one
+        long long wake = now + 100000000LL;
+        if (config->deadline_ns && config->deadline_ns < wake) wake = config->deadline_ns;
+        int busy = 0;
+        for (int i = 0; i < thread->connection_count; i++) {
+            BenchConnection* connection = &thread->connections[i];
+            if (connection->state == BENCH_WAITING) {
+                if (connection->due_ns <= now) {
+                    bench_issue(thread, connection, now);
+                } else if (connection->due_ns < wake) {
+                    wake = connection->due_ns;
                 }
             }
+            if (connection->state != BENCH_STOPPED) busy = 1;
+        }
+        if (!busy) break;
+
+        int ready = epoll_wait(thread->epfd, events, BATCH_MAX_EVENTS, (int)((wake - now) / 1000000));
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
         }
+        for (int i = 0; i < ready; i++) {
+            BenchConnection* connection = &thread->connections[events[i].data.u64 >> 32];
+            int sockfd = (int)(events[i].data.u64 & 0xffffffff);
+            if (connection->sockfd == sockfd) bench_advance(thread, connection);
+        }
+    }
+
+    for (int i = 0; i < thread->connection_count; i++) {
+        bench_close(&thread->connections[i]);
+    }
+    return NULL;
+}
+
+// Function to load a server with requests for the URL over connections spread on threads,
+// for a duration or a number of requests, and print throughput and latency percentiles.
+// Returns -1 if a thread could not start or a request failed.
+int run_bench(URLComponents* components, int param_count, char** params, int connections, int threads,
+              double seconds, long long max_requests, double rate) {
+    BenchConfig config;
+    memset(&config, 0, sizeof(BenchConfig));
+
+    // A request written to a connection the server has just reset fails with EPIPE and is sent again
+    signal(SIGPIPE, SIG_IGN);
+
+    struct hostent* server = gethostbyname(components->host);
+    if (!server || server->h_addrtype != AF_INET) {
+        herror("gethostbyname");
+        return -1;
+    }
+    memcpy(&config.address, server->h_addr, sizeof(struct in_addr));
+    config.port = components->port;
+    construct_request(config.request, components, param_count, params);
+    config.request_length = strlen(config.request);
+    config.connections = connections;
+    config.rate = rate;
+    config.max_requests = max_requests;
+    atomic_init(&config.issued, 0);
 
+    if (threads > connections) threads = connections;
+    BenchThread* bench_threads = calloc(threads, sizeof(BenchThread));
+    BenchConnection* bench_connections = calloc(connections, sizeof(BenchConnection));
+    LatencyHistogram* histogram = new_latency_histogram();
+    if (!bench_threads || !bench_connections || !histogram) {
+        perror("calloc");
+        free(bench_threads);
+        free(bench_connections);
+        free_latency_histogram(histogram);
+        return -1;
+    }
+
+    printf("Bench of http://%s:%d%s: %d connections on %d threads, ",
+           components->host, components->port, components->path, connections, threads);
+    if (max_requests) printf("%lld requests", max_requests);
+    else printf("%.1f s", seconds);
+    if (rate > 0) printf(", %.1f requests/s", rate);
+    printf("\n");
+    fflush(stdout);
+
+    long long start = now_ns();
+    if (!max_requests) config.deadline_ns = start + (long long)(seconds * 1e9);
+
+    int started = 0;
+    int first_connection = 0;
+    for (int i = 0; i < threads; i++) {
+        BenchThread* thread = &bench_threads[i];
+        thread->config = &config;
+        thread->first_connection = first_connection;
+        thread->connection_count = connections / threads + (i < connections % threads);
+        thread->connections = bench_connections + first_connection;
+        first_connection += thread->connection_count;
+        thread->histogram = new_latency_histogram();
+        thread->epfd = epoll_create1(0);
+        if (!thread->histogram || thread->epfd < 0 ||
+            pthread_create(&thread->thread, NULL, bench_thread_main, thread) != 0) {
+            perror("bench thread");
+            break;
+        }
+        started++;
+    }
+
+    long long completed = 0, errors = 0, non_2xx = 0, bytes = 0;
+    for (int i = 0; i < started; i++) {
+        BenchThread* thread = &bench_threads[i];
+        pthread_join(thread->thread, NULL);
+        latency_histogram_merge(histogram, thread->histogram);
+        completed += thread->completed;
+        errors += thread->errors;
+        non_2xx += thread->non_2xx;
+        bytes += thread->bytes;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    for (int i = 0; i < threads; i++) {
+        free_latency_histogram(bench_threads[i].histogram);
+        if (bench_threads[i].epfd > 0) close(bench_threads[i].epfd);
+    }
+
+    printf("Requests: %lld in %.3f s, %.1f requests/s\n", completed, elapsed, completed / elapsed);
+    printf("Transfer: %lld bytes, %.2f MB/s\n", bytes, bytes / elapsed / (1024 * 1024));
+    printf("Errors: %lld, non-2xx responses: %lld\n", errors, non_2xx);
+    printf("Latency%s: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+           rate > 0 ? " (from the intended send time)" : "",
+           latency_histogram_mean(histogram) / 1e6,
+           latency_histogram_percentile(histogram, 50) / 1e6,
+           latency_histogram_percentile(histogram, 90) / 1e6,
+           latency_histogram_percentile(histogram, 99) / 1e6,
+           latency_histogram_percentile(histogram, 99.9) / 1e6,
+           (histogram->total_count ? histogram->max : 0) / 1e6);
+
+    free_latency_histogram(histogram);
+    free(bench_connections);
+    free(bench_threads);
+    return started == threads && errors == 0 ? 0 : -1;
+}
+
+// Function to feed a whole response from a blocking socket to the parser.
+// Returns 0, or -1 with the reason in *error.
+int read_whole_response(int sockfd, HttpParser* parser, const char** error) {
+    char buffer[FORWARD_BUFFER_SIZE];
+    while (parser->state != HTTP_MESSAGE_DONE) {
+        ssize_t bytes_received = read(sockfd, buffer, sizeof(buffer));
+        if (bytes_received < 0) {
+            if (errno == EINTR) continue;
+            *error = strerror(errno);
+            return -1;
+        }
+        if (bytes_received == 0) {
+            if (http_parser_finish(parser) < 0) {
+                *error = parser->error;
+                return -1;
+            }
+            break;
+        }
+        http_parser_execute(parser, buffer, bytes_received);
+        if (parser->state == HTTP_PARSE_ERROR) {
+            *error = parser->error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Parser callback: take note of the headers that tell whether ranges are served
+int on_probe_header(HttpParser* parser, const char* name, const char* value) {
+    RangeProbe* probe = parser->data;
+    long long first, last, total;
+    if (strcasecmp(name, "Location") == 0 && strlen(value) < MAX_URL_LENGTH) {
+        strcpy(probe->location, value);
+    } else if (strcasecmp(name, "Accept-Ranges") == 0) {
+        probe->accepts_ranges = strcasecmp(value, "none") != 0;
+    } else if (strcasecmp(name, "Content-Range") == 0 &&
+               sscanf(value, "bytes %lld-%lld/%lld", &first, &last, &total) == 3) {
+        probe->total_length = total;
+    }
+    return 0;
+}
+
+// Parser callback: the probe only needs the headers
+int on_probe_headers_complete(HttpParser* parser) {
+    RangeProbe* probe = parser->data;
+    probe->status_code = parser->status_code;
+    return 1;
+}
+
+const HttpParserCallbacks probe_callbacks = {
+    on_probe_header,
+    on_probe_headers_complete,
+    NULL,
+    NULL
+};
+
+// Function to ask for the first byte of the URL, following redirects, to learn its length
+// and whether the server serves ranges. components becomes the final URL.
+// Returns 0, or -1 if no response came.
+int probe_ranges(URLComponents* components, int param_count, char** params, RangeProbe* probe) {
+    char request[MAX_REQUEST_LENGTH];
+    char location_url[MAX_URL_LENGTH];
+    HttpParser parser;
+
+    for (int redirect_count = 0; ; redirect_count++) {
+        int sockfd = open_connection(components->host, components->port);
+        if (sockfd < 0) return -1;
+
+        int length = construct_range_request(request, components, param_count, params, 0, 0);
+        if (write(sockfd, request, length) < 0) {
+            perror("write");
+            close(sockfd);
+            return -1;
+        }
+
+        memset(probe, 0, sizeof(RangeProbe));
+        probe->accepts_ranges = -1;
+        probe->total_length = -1;
+        http_parser_init(&parser, &probe_callbacks, probe);
+        const char* error = NULL;
+        int result = read_whole_response(sockfd, &parser, &error);
         close(sockfd);
-        break;
+        if (result < 0) {
+            fprintf(stderr, "Probe: %s\n", error);
+            return -1;
+        }
+
+        // Check for redirect
+        if (probe->status_code >= 300 && probe->status_code < 400 && probe->location[0] != '\0' &&
+            redirect_count < MAX_REDIRECTS &&
+            resolve_location_url(probe->location, location_url, components) &&
+            parse_url(location_url, components) == 0) {
+            continue;
+        }
+        return 0;
     }
+}
 
+// Parser callback: the response must be the range that was asked for
+int on_segment_header(HttpParser* parser, const char* name, const char* value) {
+    Segment* segment = parser->data;
+    long long last, total;
+    if (strcasecmp(name, "Content-Range") == 0 &&
+        sscanf(value, "bytes %lld-%lld/%lld", &segment->range_start, &last, &total) != 3) {
+        segment->range_start = -1;
+    }
+    return 0;
+}
+
+int on_segment_headers_complete(HttpParser* parser) {
+    Segment* segment = parser->data;
+    if (parser->status_code != 206 || segment->range_start != segment->offset) {
+        segment->error = "the server did not send the range";
+        return -1;
+    }
+    return 0;
+}
+
+// Parser callback: write a piece of the range at its place in the file
+int on_segment_body(HttpParser* parser, const char* data, size_t length) {
+    Segment* segment = parser->data;
+    if (segment->offset + (long long)length > segment->last + 1) {
+        segment->error = "the server sent more than the range";
+        return -1;
+    }
+    while (length > 0) {
+        ssize_t written = pwrite(segment->download->fd, data, length, segment->offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            segment->error = strerror(errno);
+            return -1;
+        }
+        data += written;
+        length -= written;
+        segment->offset += written;
+    }
     return 0;
 }
 
+const HttpParserCallbacks segment_callbacks = {
+    on_segment_header,
+    on_segment_headers_complete,
+    on_segment_body,
+    NULL
+};
+
+// Function run by the thread of each segment. A connection that breaks is replaced,
+// and the range asked for again from the first byte not written yet; the segment fails
+// after SEGMENT_MAX_RETRIES attempts in a row that wrote nothing.
+void* segment_thread_main(void* arg) {
+    Segment* segment = arg;
+    SegmentedDownload* download = segment->download;
+    char request[MAX_REQUEST_LENGTH];
+    long long start = now_ns();
+
+    for (int attempt = 0; attempt <= SEGMENT_MAX_RETRIES && segment->offset <= segment->last; attempt++) {
+        long long offset = segment->offset;
+        int sockfd = connect_to_address(download->address, download->components.port);
+        if (sockfd < 0) {
+            segment->error = strerror(errno);
+            continue;
+        }
+
+        int length = construct_range_request(request, &download->components, download->param_count,
+                                             download->params, segment->offset, segment->last);
+        HttpParser parser;
+        http_parser_init(&parser, &segment_callbacks, segment);
+        segment->range_start = -1;
+        segment->error = NULL;
+        const char* error = NULL;
+        if (write(sockfd, request, length) < 0) {
+            error = strerror(errno);
+        } else if (read_whole_response(sockfd, &parser, &error) == 0 && segment->offset <= segment->last) {
+            error = "the range ended early";
+        }
+        close(sockfd);
+        if (!segment->error) segment->error = error;
+
+        // The server will not send the range, asking again will not help
+        if (parser.status_code && parser.status_code != 206) break;
+        if (segment->offset > offset) attempt = -1;
+    }
+
+    if (segment->offset > segment->last) segment->error = NULL;
+    segment->elapsed_ns = now_ns() - start;
+    return NULL;
+}
+
+// Function to download the URL to a file in byte ranges fetched in parallel, each over its
+// own connection and written at its offset in the file, which is allocated whole beforehand.
+// Servers that do not serve ranges get a single request, as without segments.
+int download_segmented(URLComponents* components, int param_count, char** params,
+                       const char* output_path, int segments) {
+    RangeProbe probe;
+    if (probe_ranges(components, param_count, params, &probe) < 0) return -1;
+
+    if (probe.status_code != 206 || probe.total_length <= 0 || probe.accepts_ranges == 0) {
+        printf("No ranges served for http://%s:%d%s (status %d), downloading in one stream\n",
+               components->host, components->port, components->path, probe.status_code);
+        fflush(stdout);
+        int output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0) {
+            perror(output_path);
+            return -1;
+        }
+        int result = send_request(components, param_count, params, output_fd);
+        if (close(output_fd) < 0) {
+            perror(output_path);
+            result = -1;
+        }
+        return result;
+    }
+
+    SegmentedDownload download;
+    memset(&download, 0, sizeof(SegmentedDownload));
+    struct hostent* server = gethostbyname(components->host);
+    if (!server || server->h_addrtype != AF_INET) {
+        herror("gethostbyname");
+        return -1;
+    }
+    memcpy(&download.address, server->h_addr, sizeof(struct in_addr));
+    download.components = *components;
+    download.param_count = param_count;
+    download.params = params;
+
+    // Allocate the whole file first, so that segments land in place and the disk cannot fill up midway
+    download.fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (download.fd < 0) {
+        perror(output_path);
+        return -1;
+    }
+    int error = posix_fallocate(download.fd, 0, probe.total_length);
+    if (error == EINVAL || error == EOPNOTSUPP) {
+        error = ftruncate(download.fd, probe.total_length) < 0 ? errno : 0;
+    }
+    if (error) {
+        fprintf(stderr, "%s: %s\n", output_path, strerror(error));
+        close(download.fd);
+        return -1;
+    }
+
+    // Segments are no shorter than SEGMENT_MIN_LENGTH, the last one takes the rest
+    long long segment_length = probe.total_length / segments;
+    if (segment_length < SEGMENT_MIN_LENGTH) {
+        segment_length = SEGMENT_MIN_LENGTH;
+        segments = (probe.total_length + SEGMENT_MIN_LENGTH - 1) / SEGMENT_MIN_LENGTH;
+    }
+    Segment* segment_list = calloc(segments, sizeof(Segment));
+    if (!segment_list) {
+        perror("calloc");
+        close(download.fd);
+        return -1;
+    }
+
+    printf("Downloading %lld bytes of http://%s:%d%s in %d segments to %s\n", probe.total_length,
+           components->host, components->port, components->path, segments, output_path);
+    fflush(stdout);
+
+    long long start = now_ns();
+    int started = 0;
+    for (int i = 0; i < segments; i++) {
+        Segment* segment = &segment_list[i];
+        segment->download = &download;
+        segment->first = i * segment_length;
+        segment->last = i == segments - 1 ? probe.total_length - 1 : segment->first + segment_length - 1;
+        segment->offset = segment->first;
+        if (pthread_create(&segment->thread, NULL, segment_thread_main, segment) != 0) {
+            perror("segment thread");
+            break;
+        }
+        started++;
+    }
+
+    int result = started == segments ? 0 : -1;
+    long long total_bytes = 0;
+    for (int i = 0; i < started; i++) {
+        Segment* segment = &segment_list[i];
+        pthread_join(segment->thread, NULL);
+        total_bytes += segment->offset - segment->first;
+        if (segment->error) {
+            printf("Segment %d, bytes %lld-%lld: FAILED at byte %lld: %s\n",
+                   i, segment->first, segment->last, segment->offset, segment->error);
+            result = -1;
+        } else {
+            printf("Segment %d, bytes %lld-%lld: %.3f s\n",
+                   i, segment->first, segment->last, segment->elapsed_ns / 1e9);
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    printf("\nTotal received body bytes: %lld in %.3f s, %.2f MB/s\n",
+           total_bytes, elapsed, total_bytes / elapsed / (1024 * 1024));
+
+    if (close(download.fd) < 0) {
+        perror(output_path);
+        result = -1;
+    }
+    free(segment_list);
+    return result;
+}
+
 int main(int argc, char* argv[]) {
     int param_count = 0;
     char** params = NULL;
     char* url = NULL;
+    char* output_path = NULL;
+    char* list_path = NULL;
+    int concurrency = 0;
+    int window = 1;
+    int segments = 0;
+    int bench = 0;
+    int threads = BENCH_THREADS;
+    double seconds = 0;
+    long long max_requests = 0;
+    double rate = 0;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-r") == 0) {
+        if (strcmp(argv[i], "-b") == 0) {
+            if (i + 1 >= argc || list_path != NULL) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+            list_path = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0) {
+            char* endptr = NULL;
+            if (i + 1 < argc) concurrency = strtol(argv[++i], &endptr, 10);
+            if (!endptr || *endptr != '\0' || concurrency <= 0) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            char* endptr = NULL;
+            if (i + 1 < argc) window = strtol(argv[++i], &endptr, 10);
+            if (!endptr || *endptr != '\0' || window <= 0 || window > BATCH_MAX_WINDOW) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0) {
+            char* endptr = NULL;
+            if (i + 1 < argc) segments = strtol(argv[++i], &endptr, 10);
+            if (!endptr || *endptr != '\0' || segments <= 0 || segments > MAX_SEGMENTS) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "-d") == 0 ||
+                   strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-R") == 0) {
+            char* endptr = NULL;
+            double value = 0;
+            if (i + 1 < argc) value = strtod(argv[i + 1], &endptr);
+            if (!endptr || *endptr != '\0' || value <= 0) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+            switch (argv[i][1]) {
+                case 't': threads = (int)value; break;
+                case 'd': seconds = value; break;
+                case 'n': max_requests = (long long)value; break;
+                case 'R': rate = value; break;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc || output_path != NULL) {
+                fprintf(stderr, USAGE_MESSAGE);
+                if (params) free(params);
+                return 1;
+            }
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0) {
             if (i + 1 >= argc) {
-                fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+                fprintf(stderr, USAGE_MESSAGE);
                 return 1;
             }
 
@@ -291,7 +2015,7 @@ int main(int argc, char* argv[]) {
             char* endptr;
             param_count = strtol(argv[i], &endptr, 10);
             if (*endptr != '\0' || param_count < 0) {
-                fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+                fprintf(stderr, USAGE_MESSAGE);
                 return 1;
             }
 
@@ -299,12 +2023,12 @@ int main(int argc, char* argv[]) {
                 params = malloc(param_count * sizeof(char*));
                 for (int j = 0; j < param_count; j++) {
                     if (++i >= argc) {
-                        fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+                        fprintf(stderr, USAGE_MESSAGE);
                         free(params);
                         return 1;
                     }
                     if (strchr(argv[i], '=') == NULL) {
-                        fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+                        fprintf(stderr, USAGE_MESSAGE);
                         free(params);
                         return 1;
                     }
@@ -313,7 +2037,7 @@ int main(int argc, char* argv[]) {
             }
         } else {
             if (url != NULL) {
-                fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+                fprintf(stderr, USAGE_MESSAGE);
                 if (params) free(params);
                 return 1;
             }
@@ -321,8 +2045,28 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Batch mode: URLs from a list, bodies to a directory
+    if (list_path != NULL) {
+        if (url != NULL || segments) {
+            fprintf(stderr, USAGE_MESSAGE);
+            if (params) free(params);
+            return 1;
+        }
+        FILE* list = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+        if (!list) {
+            perror(list_path);
+            if (params) free(params);
+            return 1;
+        }
+        int result = run_batch(list, output_path ? output_path : ".",
+                               concurrency ? concurrency : BATCH_CONCURRENCY, window, param_count, params);
+        if (list != stdin) fclose(list);
+        if (params) free(params);
+        return result == 0 ? 0 : 1;
+    }
+
     if (url == NULL) {
-        fprintf(stderr, "Usage: client [-r n < pr1=value1 pr2=value2 ...>] <URL>\n");
+        fprintf(stderr, USAGE_MESSAGE);
         if (params) free(params);
         return 1;
     }
@@ -334,9 +2078,51 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // Load generator: the same request over and over
+    if (bench) {
+        if (output_path || segments || (seconds > 0 && max_requests > 0) || threads < 1 ||
+            threads > BENCH_MAX_THREADS) {
+            fprintf(stderr, USAGE_MESSAGE);
+            if (params) free(params);
+            return 1;
+        }
+        if (seconds == 0 && max_requests == 0) seconds = BENCH_DURATION_SECONDS;
+        int result = run_bench(&components, param_count, params, concurrency ? concurrency : BENCH_CONNECTIONS,
+                               threads, seconds, max_requests, rate);
+        if (params) free(params);
+        return result == 0 ? 0 : 1;
+    }
+
+    // Segmented download: byte ranges in parallel, straight to their place in the file
+    if (segments) {
+        if (!output_path) {
+            fprintf(stderr, USAGE_MESSAGE);
+            if (params) free(params);
+            return 1;
+        }
+        int result = download_segmented(&components, param_count, params, output_path, segments);
+        if (params) free(params);
+        return result == 0 ? 0 : 1;
+    }
+
+    // The body goes to stdout, or to a file
+    int output_fd = STDOUT_FILENO;
+    if (output_path) {
+        output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0) {
+            perror(output_path);
+            if (params) free(params);
+            return 1;
+        }
+    }
+
     // Send request and handle response
-    int result = send_request(&components, param_count, params);
+    int result = send_request(&components, param_count, params, output_fd);
 
+    if (output_fd != STDOUT_FILENO && close(output_fd) < 0) {
+        perror(output_path);
+        result = -1;
+    }
     if (params) free(params);
     return result;
 }
@@ -0,0 +1,315 @@
+#include "http_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+void http_parser_init(HttpParser* parser, const HttpParserCallbacks* callbacks, void* data) {
+    parser->callbacks = callbacks;
+    parser->data = data;
+    http_parser_reset(parser);
+}
+
+void http_parser_reset(HttpParser* parser) {
+    parser->state = HTTP_STATUS_LINE;
+    parser->error = NULL;
+    parser->http_minor = 0;
+    parser->status_code = 0;
+    parser->keep_alive = 0;
+    parser->chunked = 0;
+    parser->content_length = -1;
+    parser->remaining = 0;
+    parser->header_bytes = 0;
+    parser->line_length = 0;
+}
+
+// Function to stop the parser, returns how many bytes were used
+static size_t fail(HttpParser* parser, const char* error, size_t used) {
+    parser->state = HTTP_PARSE_ERROR;
+    parser->error = error;
+    return used;
+}
+
+// Function to end the message
+static int complete(HttpParser* parser) {
+    parser->state = HTTP_MESSAGE_DONE;
+    if (parser->callbacks && parser->callbacks->on_message_complete) {
+        return parser->callbacks->on_message_complete(parser);
+    }
+    return 0;
+}
+
+// Function to check whether a comma separated header value lists a token
+static int has_token(const char* value, const char* token) {
+    size_t token_length = strlen(token);
+    while (*value) {
+        while (*value == ' ' || *value == '\t' || *value == ',') value++;
+        const char* end = value;
+        while (*end && *end != ',') end++;
+        const char* stop = end;
+        while (stop > value && (stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+        if ((size_t)(stop - value) == token_length && strncasecmp(value, token, token_length) == 0) {
+            return 1;
+        }
+        value = end;
+    }
+    return 0;
+}
+
+// Function to parse "HTTP/1.x nnn reason", returns 0 if valid
+static int parse_status_line(HttpParser* parser, const char* line) {
+    if (strncmp(line, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)line[7]) || line[8] != ' ') return -1;
+    if (!isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) ||
+        !isdigit((unsigned char)line[11]) || (line[12] != ' ' && line[12] != '\0')) {
+        return -1;
+    }
+    parser->http_minor = line[7] - '0';
+    parser->status_code = atoi(line + 9);
+
+    // HTTP/1.1 keeps the connection open unless told otherwise, HTTP/1.0 closes it
+    parser->keep_alive = parser->http_minor >= 1;
+    return 0;
+}
+
+// Function to split "Name: value" and take note of the headers that frame the body
+static int parse_header_line(HttpParser* parser, char* line) {
+    char* colon = strchr(line, ':');
+    if (!colon || colon == line) return -1;
+    *colon = '\0';
+
+    char* value = colon + 1;
+    while (*value == ' ' || *value == '\t') value++;
+    char* end = value + strlen(value);
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+        char* digits_end;
+        if (!isdigit((unsigned char)*value)) return -1;
+        errno = 0;
+        long long length = strtoll(value, &digits_end, 10);
+        if (*digits_end != '\0' || errno == ERANGE) return -1;   // not a number, or too large for one
+        if (parser->content_length >= 0 && parser->content_length != length) return -1;
+        parser->content_length = length;
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+        // chunked is always the last coding applied
+        size_t length = strlen(value);
+        parser->chunked = length >= 7 && strcasecmp(value + length - 7, "chunked") == 0;
+    } else if (strcasecmp(line, "Connection") == 0) {
+        if (has_token(value, "close")) parser->keep_alive = 0;
+        else if (has_token(value, "keep-alive")) parser->keep_alive = 1;
+    }
+
+    if (parser->callbacks && parser->callbacks->on_header) {
+        return parser->callbacks->on_header(parser, line, value) == 0 ? 0 : -1;
+    }
+    return 0;
+}
+
+// Function to pick how the body is framed once the headers are done.
+// Returns 0, or -1 if a callback asked to stop.
+static int start_body(HttpParser* parser) {
+    int skip_body = 0;
+    if (parser->callbacks && parser->callbacks->on_headers_complete) {
+        skip_body = parser->callbacks->on_headers_complete(parser);
+        if (skip_body < 0) return -1;
+    }
+
+    if (skip_body || parser->status_code == 204 || parser->status_code == 304 ||
+        (parser->status_code >= 100 && parser->status_code < 200)) {
+        if (parser->status_code == 101) parser->keep_alive = 0;   // the connection is no longer HTTP
+        return complete(parser);
+    }
+    if (parser->chunked) {
+        parser->state = HTTP_CHUNK_SIZE;
+        parser->remaining = 0;
+        return 0;
+    }
+    if (parser->content_length >= 0) {
+        parser->remaining = parser->content_length;
+        parser->state = HTTP_BODY_IDENTITY;
+        return parser->remaining == 0 ? complete(parser) : 0;
+    }
+    // Without a length the body ends with the connection
+    parser->keep_alive = 0;
+    parser->state = HTTP_BODY_UNTIL_CLOSE;
+    return 0;
+}
+
+// Function to act on a complete line (without its line ending) in a line state
+static int end_of_line(HttpParser* parser, char* line) {
+    switch (parser->state) {
+        case HTTP_STATUS_LINE:
+            if (parse_status_line(parser, line) < 0) {
+                parser->error = "Malformed status line";
+                return -1;
+            }
+            parser->state = HTTP_HEADER_LINE;
+            return 0;
+
+        case HTTP_HEADER_LINE:
+            if (*line == '\0') {
+                // Interim responses (100 Continue) are followed by the real one
+                if (parser->status_code >= 100 && parser->status_code < 200 && parser->status_code != 101) {
+                    size_t header_bytes = parser->header_bytes;
+                    http_parser_reset(parser);
+                    parser->header_bytes = header_bytes;
+                    return 0;
+                }
+                if (start_body(parser) < 0) {
+                    parser->error = "Stopped by callback";
+                    return -1;
+                }
+                return 0;
+            }
+            if (*line == ' ' || *line == '\t') return 0;    // obsolete line folding, ignored
+            if (parse_header_line(parser, line) < 0) {
+                parser->error = "Malformed header";
+                return -1;
+            }
+            return 0;
+
+        case HTTP_CHUNK_SIZE: {
+            char* end;
+            if (!isxdigit((unsigned char)*line)) {
+                parser->error = "Malformed chunk size";
+                return -1;
+            }
+            errno = 0;
+            parser->remaining = strtoll(line, &end, 16);
+            while (*end == ' ' || *end == '\t') end++;
+            if ((*end != '\0' && *end != ';') || parser->remaining < 0 || errno == ERANGE) {
+                parser->error = "Malformed chunk size";
+                return -1;
+            }
+            parser->state = parser->remaining ? HTTP_CHUNK_DATA : HTTP_CHUNK_TRAILER;
+            return 0;
+        }
+
+        case HTTP_CHUNK_DATA_END:
+            if (*line != '\0') {
+                parser->error = "Missing CRLF after chunk data";
+                return -1;
+            }
+            parser->state = HTTP_CHUNK_SIZE;
+            return 0;
+
+        case HTTP_CHUNK_TRAILER:
+            if (*line == '\0' && complete(parser) != 0) {
+                parser->error = "Stopped by callback";
+                return -1;
+            }
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+size_t http_parser_execute(HttpParser* parser, const char* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        switch (parser->state) {
+            case HTTP_MESSAGE_DONE:
+            case HTTP_PARSE_ERROR:
+                return i;
+
+            case HTTP_BODY_IDENTITY:
+            case HTTP_BODY_UNTIL_CLOSE:
+            case HTTP_CHUNK_DATA: {
+                size_t taken = length - i;
+                if (parser->state != HTTP_BODY_UNTIL_CLOSE && (long long)taken > parser->remaining) {
+                    taken = parser->remaining;
+                }
+                if (parser->callbacks && parser->callbacks->on_body &&
+                    parser->callbacks->on_body(parser, data + i, taken) != 0) {
+                    return fail(parser, "Stopped by callback", i);
+                }
+                i += taken;
+                if (parser->state == HTTP_BODY_UNTIL_CLOSE) break;
+
+                parser->remaining -= taken;
+                if (parser->remaining == 0) {
+                    if (parser->state == HTTP_CHUNK_DATA) {
+                        parser->state = HTTP_CHUNK_DATA_END;
+                    } else if (complete(parser) != 0) {
+                        return fail(parser, "Stopped by callback", i);
+                    }
+                }
+                break;
+            }
+
+            default: {
+                // A line: gather it up to LF, CR LF or bare LF alike
+                const char* newline = memchr(data + i, '\n', length - i);
+                size_t piece = newline ? (size_t)(newline - (data + i)) : length - i;
+                if (parser->line_length + piece >= HTTP_MAX_LINE_LENGTH) {
+                    return fail(parser, "Line too long", i);
+                }
+                memcpy(parser->line + parser->line_length, data + i, piece);
+                parser->line_length += piece;
+                i += piece;
+                if (parser->state == HTTP_STATUS_LINE || parser->state == HTTP_HEADER_LINE) {
+                    parser->header_bytes += piece;
+                }
+                if (!newline) break;
+
+                i++;    // the LF
+                if (parser->state == HTTP_STATUS_LINE || parser->state == HTTP_HEADER_LINE) {
+                    parser->header_bytes++;
+                }
+                if (parser->line_length > 0 && parser->line[parser->line_length - 1] == '\r') {
+                    parser->line_length--;
+                }
+                parser->line[parser->line_length] = '\0';
+                parser->line_length = 0;
+
+                // Tolerate empty lines before the status line
+                if (parser->state == HTTP_STATUS_LINE && parser->line[0] == '\0') break;
+
+                if (end_of_line(parser, parser->line) < 0) {
+                    parser->state = HTTP_PARSE_ERROR;
+                    return i;
+                }
+                break;
+            }
+        }
+    }
+    return i;
+}
+
+int http_parser_finish(HttpParser* parser) {
+    switch (parser->state) {
+        case HTTP_BODY_UNTIL_CLOSE:
+            return complete(parser) == 0 ? 0 : -1;
+        case HTTP_MESSAGE_DONE:
+            return 0;
+        case HTTP_STATUS_LINE:
+            if (parser->line_length == 0 && parser->header_bytes == 0) return 0;
+            // fall through
+        default:
+            if (parser->state != HTTP_PARSE_ERROR) {
+                parser->state = HTTP_PARSE_ERROR;
+                parser->error = "Connection closed before the end of the response";
+            }
+            return -1;
+    }
+}
+
+long long http_parser_body_remaining(const HttpParser* parser) {
+    if (parser->state == HTTP_BODY_IDENTITY) return parser->remaining;
+    if (parser->state == HTTP_BODY_UNTIL_CLOSE) return -1;
+    return 0;
+}
+
+void http_parser_skip_body(HttpParser* parser, size_t count) {
+    if (parser->state != HTTP_BODY_IDENTITY) return;
+    parser->remaining -= count;
+    if (parser->remaining <= 0) {
+        parser->remaining = 0;
+        if (complete(parser) != 0) {
+            parser->state = HTTP_PARSE_ERROR;
+            parser->error = "Stopped by callback";
+        }
+    }
+}
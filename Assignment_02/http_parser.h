@@ -0,0 +1,107 @@
+#ifndef _HTTP_PARSER_H_
+#define _HTTP_PARSER_H_
+
+#include <stddef.h>
+
+/**
+ * http_parser.h
+ *
+ * An incremental parser for HTTP/1.x responses. Bytes are fed to it as they
+ * arrive, in pieces of any size, and it calls back with the headers, the
+ * body (with the chunk framing removed) and the end of the message, which it
+ * finds from Content-Length, Transfer-Encoding: chunked, or the end of the
+ * connection. It never buffers the body, only the current header line.
+ */
+
+// longest status, header or chunk size line
+#define HTTP_MAX_LINE_LENGTH 8192
+
+typedef enum {
+    HTTP_STATUS_LINE,
+    HTTP_HEADER_LINE,
+    HTTP_BODY_IDENTITY,     // Content-Length bytes
+    HTTP_BODY_UNTIL_CLOSE,  // everything until the peer closes
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_DATA_END,    // the CRLF after the data of a chunk
+    HTTP_CHUNK_TRAILER,
+    HTTP_MESSAGE_DONE,
+    HTTP_PARSE_ERROR
+} HttpParserState;
+
+typedef struct HttpParser HttpParser;
+
+/**
+ * Called as parts of a response are recognized, each of them optional.
+ * Returning non zero from on_header, on_body or on_message_complete stops
+ * the parser with an error. on_headers_complete returns 1 if the response
+ * has no body whatever its headers say (the answer to a HEAD request),
+ * 0 to go on, -1 to stop with an error.
+ */
+typedef struct {
+    int (*on_header)(HttpParser* parser, const char* name, const char* value);
+    int (*on_headers_complete)(HttpParser* parser);
+    int (*on_body)(HttpParser* parser, const char* data, size_t length);
+    int (*on_message_complete)(HttpParser* parser);
+} HttpParserCallbacks;
+
+struct HttpParser {
+    HttpParserState state;
+    const HttpParserCallbacks* callbacks;
+    void* data;                 // for the callbacks
+    const char* error;          // what went wrong, once in HTTP_PARSE_ERROR
+
+    // What the status line and headers said, valid from on_headers_complete
+    int http_minor;             // 0 for HTTP/1.0, 1 for HTTP/1.1
+    int status_code;
+    int keep_alive;             // the connection may carry another message
+    int chunked;
+    long long content_length;   // -1 if not given
+
+    long long remaining;        // body bytes left, or in the current chunk
+    size_t header_bytes;        // length of the status line and headers, interim responses included
+    size_t line_length;
+    char line[HTTP_MAX_LINE_LENGTH];
+};
+
+/**
+ * Prepare a parser for the first response on a connection.
+ */
+void http_parser_init(HttpParser* parser, const HttpParserCallbacks* callbacks, void* data);
+
+/**
+ * Prepare a parser for the next response on the same connection,
+ * keeping its callbacks.
+ */
+void http_parser_reset(HttpParser* parser);
+
+/**
+ * Feed bytes to the parser. It stops at the end of the message, so that what
+ * follows (the next pipelined response) is left for the next one.
+ * Returns the number of bytes used; fewer than length means the message is
+ * done or an error occurred.
+ */
+size_t http_parser_execute(HttpParser* parser, const char* data, size_t length);
+
+/**
+ * Tell the parser the connection was closed. This ends a body that runs
+ * until close. Returns 0 if the message is complete (or none had started),
+ * -1 if it was cut short.
+ */
+int http_parser_finish(HttpParser* parser);
+
+/**
+ * Body bytes still expected when their number is known and nothing else is
+ * (a Content-Length body), so that the caller can move them itself, e.g. with
+ * splice(). Returns -1 while the body runs until close, 0 in any other state.
+ */
+long long http_parser_body_remaining(const HttpParser* parser);
+
+/**
+ * Account for count body bytes the caller moved past the parser.
+ * count must not be more than http_parser_body_remaining() unless the body
+ * runs until close.
+ */
+void http_parser_skip_body(HttpParser* parser, size_t count);
+
+#endif /* _HTTP_PARSER_H_ */
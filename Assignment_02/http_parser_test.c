@@ -0,0 +1,234 @@
+#include "http_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GREEN "\033[0;32m"
+#define RED "\033[0;31m"
+#define RESET "\033[0m"
+
+#define CHUNKED_RESPONSE "HTTP/1.1 200 OK\r\n" \
+                         "Transfer-Encoding: chunked\r\n" \
+                         "\r\n" \
+                         "4\r\nWiki\r\n" \
+                         "5;name=value\r\npedia\r\n" \
+                         "E\r\n in\r\n\r\nchunks.\r\n" \
+                         "0\r\n" \
+                         "Trailer: yes\r\n" \
+                         "\r\n"
+#define CHUNKED_BODY "Wikipedia in\r\n\r\nchunks."
+
+int passed_tests = 0;
+int total_tests = 0;
+
+// What the callbacks saw of one response
+typedef struct {
+    char body[256];
+    size_t body_length;
+    int headers_complete;
+    int skip_body;              // returned from on_headers_complete
+} Collected;
+
+void print_test_result(const char* test_name, int passed, const HttpParser* parser) {
+    total_tests++;
+    if (passed) {
+        passed_tests++;
+        printf("%s✓ %s: PASSED%s\n", GREEN, test_name, RESET);
+    } else {
+        printf("%s✗ %s: FAILED%s\n", RED, test_name, RESET);
+        printf("State %d, status %d, error %s\n", parser->state, parser->status_code,
+               parser->error ? parser->error : "none");
+    }
+}
+
+int on_headers_complete(HttpParser* parser) {
+    Collected* collected = parser->data;
+    collected->headers_complete = 1;
+    return collected->skip_body;
+}
+
+int on_body(HttpParser* parser, const char* data, size_t length) {
+    Collected* collected = parser->data;
+    if (collected->body_length + length > sizeof(collected->body)) return -1;
+    memcpy(collected->body + collected->body_length, data, length);
+    collected->body_length += length;
+    return 0;
+}
+
+const HttpParserCallbacks test_callbacks = {NULL, on_headers_complete, on_body, NULL};
+
+// Function to parse a whole response in one piece, returns the bytes used
+size_t parse(HttpParser* parser, Collected* collected, const char* response) {
+    memset(collected, 0, sizeof(Collected));
+    http_parser_init(parser, &test_callbacks, collected);
+    return http_parser_execute(parser, response, strlen(response));
+}
+
+int body_is(const Collected* collected, const char* body) {
+    return collected->body_length == strlen(body) && memcmp(collected->body, body, collected->body_length) == 0;
+}
+
+void test_content_length() {
+    HttpParser parser;
+    Collected collected;
+    const char* response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    size_t used = parse(&parser, &collected, response);
+    print_test_result("Content-Length body",
+                      parser.state == HTTP_MESSAGE_DONE && used == strlen(response) &&
+                      parser.status_code == 200 && parser.keep_alive && body_is(&collected, "hello"),
+                      &parser);
+}
+
+// Split in two at every offset, then fed one byte at a time
+void test_split_chunked() {
+    HttpParser parser;
+    Collected collected;
+    size_t length = strlen(CHUNKED_RESPONSE);
+    int passed = 1;
+    for (size_t split = 0; split <= length && passed; split++) {
+        memset(&collected, 0, sizeof(Collected));
+        http_parser_init(&parser, &test_callbacks, &collected);
+        size_t used = http_parser_execute(&parser, CHUNKED_RESPONSE, split);
+        used += http_parser_execute(&parser, CHUNKED_RESPONSE + split, length - split);
+        passed = parser.state == HTTP_MESSAGE_DONE && used == length && body_is(&collected, CHUNKED_BODY);
+    }
+    print_test_result("Chunked body split in two anywhere", passed, &parser);
+
+    memset(&collected, 0, sizeof(Collected));
+    http_parser_init(&parser, &test_callbacks, &collected);
+    for (size_t i = 0; i < length; i++) {
+        http_parser_execute(&parser, CHUNKED_RESPONSE + i, 1);
+    }
+    print_test_result("Chunked body one byte at a time",
+                      parser.state == HTTP_MESSAGE_DONE && parser.chunked && body_is(&collected, CHUNKED_BODY),
+                      &parser);
+}
+
+void test_conflicting_content_length() {
+    HttpParser parser;
+    Collected collected;
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!");
+    print_test_result("Conflicting Content-Length",
+                      parser.state == HTTP_PARSE_ERROR && !collected.headers_complete, &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello");
+    print_test_result("Repeated equal Content-Length",
+                      parser.state == HTTP_MESSAGE_DONE && body_is(&collected, "hello"), &parser);
+}
+
+void test_body_until_close() {
+    HttpParser parser;
+    Collected collected;
+    parse(&parser, &collected, "HTTP/1.0 200 OK\r\n\r\nall of ");
+    http_parser_execute(&parser, "it", 2);
+    int open_ended = parser.state == HTTP_BODY_UNTIL_CLOSE && !parser.keep_alive &&
+                     http_parser_body_remaining(&parser) == -1;
+    int finished = http_parser_finish(&parser) == 0;
+    print_test_result("Body until close",
+                      open_ended && finished && parser.state == HTTP_MESSAGE_DONE &&
+                      body_is(&collected, "all of it"),
+                      &parser);
+
+    // A body of known length cut short is an error
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort");
+    print_test_result("Content-Length body cut short",
+                      http_parser_finish(&parser) < 0 && parser.state == HTTP_PARSE_ERROR, &parser);
+
+    // Closing before any response is not
+    memset(&collected, 0, sizeof(Collected));
+    http_parser_init(&parser, &test_callbacks, &collected);
+    print_test_result("Close before any response", http_parser_finish(&parser) == 0, &parser);
+}
+
+void test_overflowing_sizes() {
+    HttpParser parser;
+    Collected collected;
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nContent-Length: 99999999999999999999\r\n\r\n");
+    print_test_result("Overflowing Content-Length",
+                      parser.state == HTTP_PARSE_ERROR && strcmp(parser.error, "Malformed header") == 0, &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nfffffffffffffffff\r\n");
+    print_test_result("Overflowing chunk size",
+                      parser.state == HTTP_PARSE_ERROR && strcmp(parser.error, "Malformed chunk size") == 0,
+                      &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n8000000000000000\r\n");
+    print_test_result("Chunk size above LLONG_MAX",
+                      parser.state == HTTP_PARSE_ERROR && strcmp(parser.error, "Malformed chunk size") == 0,
+                      &parser);
+}
+
+// The parser stops at the end of a response, the next one is left for the caller
+void test_pipelined_responses() {
+    HttpParser parser;
+    Collected collected;
+    const char* first = "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\none";
+    char responses[256];
+    snprintf(responses, sizeof(responses), "%s%s", first, CHUNKED_RESPONSE);
+
+    size_t used = parse(&parser, &collected, responses);
+    int first_done = parser.state == HTTP_MESSAGE_DONE && used == strlen(first) && body_is(&collected, "one");
+
+    memset(&collected, 0, sizeof(Collected));
+    http_parser_reset(&parser);
+    used += http_parser_execute(&parser, responses + used, strlen(responses) - used);
+    print_test_result("Pipelined responses",
+                      first_done && parser.state == HTTP_MESSAGE_DONE && used == strlen(responses) &&
+                      body_is(&collected, CHUNKED_BODY),
+                      &parser);
+}
+
+void test_interim_and_bodiless_responses() {
+    HttpParser parser;
+    Collected collected;
+    const char* response = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    parse(&parser, &collected, response);
+    print_test_result("100 Continue before the response",
+                      parser.state == HTTP_MESSAGE_DONE && parser.status_code == 200 &&
+                      parser.header_bytes == strlen(response) - 2 && body_is(&collected, "ok"),
+                      &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\n\r\n");
+    print_test_result("304 has no body", parser.state == HTTP_MESSAGE_DONE, &parser);
+
+    memset(&collected, 0, sizeof(Collected));
+    collected.skip_body = 1;
+    http_parser_init(&parser, &test_callbacks, &collected);
+    const char* head = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n";
+    http_parser_execute(&parser, head, strlen(head));
+    print_test_result("Body skipped by callback",
+                      parser.state == HTTP_MESSAGE_DONE && collected.body_length == 0, &parser);
+}
+
+void test_malformed_responses() {
+    HttpParser parser;
+    Collected collected;
+    parse(&parser, &collected, "HTTP/2 200 OK\r\n\r\n");
+    print_test_result("Malformed status line", parser.state == HTTP_PARSE_ERROR, &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nContent-Length: 5x\r\n\r\n");
+    print_test_result("Content-Length not a number", parser.state == HTTP_PARSE_ERROR, &parser);
+
+    parse(&parser, &collected, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcX\r\n");
+    print_test_result("Missing CRLF after chunk data", parser.state == HTTP_PARSE_ERROR, &parser);
+}
+
+int main() {
+    printf("\n🚀 Starting HTTP Parser Tests...\n\n");
+
+    test_content_length();
+    test_split_chunked();
+    test_conflicting_content_length();
+    test_body_until_close();
+    test_overflowing_sizes();
+    test_pipelined_responses();
+    test_interim_and_bodiless_responses();
+    test_malformed_responses();
+
+    // Print summary
+    printf("\n📊 Test Summary:\n");
+    printf("Passed: %d\n", passed_tests);
+    printf("Failed: %d\n", total_tests - passed_tests);
+    printf("Total: %d\n", total_tests);
+    return (passed_tests == total_tests) ? 0 : 1;
+}
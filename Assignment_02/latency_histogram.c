@@ -0,0 +1,74 @@
+#include "latency_histogram.h"
+#include <stdlib.h>
+
+LatencyHistogram* new_latency_histogram(void) {
+    LatencyHistogram* histogram = calloc(1, sizeof(LatencyHistogram));
+    if (histogram) histogram->min = UINT64_MAX;
+    return histogram;
+}
+
+void free_latency_histogram(LatencyHistogram* histogram) {
+    free(histogram);
+}
+
+// Function to map a value to its bucket: values below 2^10 have one bucket each,
+// above that each power of two is split into 1024 buckets
+static int bucket_index(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKET_COUNT) return (int)value;
+
+    int magnitude = 63 - __builtin_clzll(value);    // 2^magnitude <= value
+    int shift = magnitude - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKET_COUNT + (int)((value >> shift) - LATENCY_SUB_BUCKET_COUNT);
+}
+
+// Function to get the highest value that falls in a bucket
+static uint64_t bucket_upper_value(int index) {
+    if (index < LATENCY_SUB_BUCKET_COUNT) return (uint64_t)index;
+
+    int shift = index / LATENCY_SUB_BUCKET_COUNT - 1;
+    uint64_t sub_bucket = LATENCY_SUB_BUCKET_COUNT + index % LATENCY_SUB_BUCKET_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void latency_histogram_record(LatencyHistogram* histogram, uint64_t value) {
+    if (value >= (1ULL << LATENCY_MAX_BITS)) value = (1ULL << LATENCY_MAX_BITS) - 1;
+
+    histogram->counts[bucket_index(value)]++;
+    histogram->total_count++;
+    histogram->sum += (double)value;
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+void latency_histogram_merge(LatencyHistogram* into, const LatencyHistogram* from) {
+    for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total_count += from->total_count;
+    into->sum += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+uint64_t latency_histogram_percentile(const LatencyHistogram* histogram, double percentile) {
+    if (histogram->total_count == 0) return 0;
+    if (percentile > 100) percentile = 100;
+
+    // The rank of the value, from 1
+    uint64_t rank = (uint64_t)(percentile / 100 * (double)histogram->total_count + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_upper_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+double latency_histogram_mean(const LatencyHistogram* histogram) {
+    return histogram->total_count ? histogram->sum / (double)histogram->total_count : 0;
+}
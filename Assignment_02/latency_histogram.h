@@ -0,0 +1,58 @@
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+/**
+ * latency_histogram.h
+ *
+ * An HDR-style histogram of latencies in nanoseconds. Values are counted in
+ * log-linear buckets: 1024 linear sub-buckets per power of two, so every
+ * value is kept to about 3 significant digits (0.1%) from 1 ns up to about
+ * 18 minutes, in a fixed amount of memory, and recording is a few shifts.
+ */
+
+// sub-buckets per power of two: 2^10
+#define LATENCY_SUB_BUCKET_BITS 10
+#define LATENCY_SUB_BUCKET_COUNT (1 << LATENCY_SUB_BUCKET_BITS)
+// values from 2^40 ns up are counted as 2^40 - 1
+#define LATENCY_MAX_BITS 40
+#define LATENCY_BUCKET_COUNT ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_COUNT)
+
+typedef struct {
+    uint64_t total_count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t counts[LATENCY_BUCKET_COUNT];
+} LatencyHistogram;
+
+/**
+ * Allocate an empty histogram, NULL on failure.
+ */
+LatencyHistogram* new_latency_histogram(void);
+
+void free_latency_histogram(LatencyHistogram* histogram);
+
+/**
+ * Count one value, in nanoseconds.
+ */
+void latency_histogram_record(LatencyHistogram* histogram, uint64_t value);
+
+/**
+ * Add the counts of from to into.
+ */
+void latency_histogram_merge(LatencyHistogram* into, const LatencyHistogram* from);
+
+/**
+ * The value below which percentile percent of the values are (0 to 100),
+ * as the upper end of its bucket; 0 for an empty histogram.
+ */
+uint64_t latency_histogram_percentile(const LatencyHistogram* histogram, double percentile);
+
+/**
+ * Mean of the values, 0 for an empty histogram.
+ */
+double latency_histogram_mean(const LatencyHistogram* histogram);
+
+#endif /* _LATENCY_HISTOGRAM_H_ */
@@ -0,0 +1,154 @@
+#include "latency_histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define GREEN "\033[0;32m"
+#define RED "\033[0;31m"
+#define RESET "\033[0m"
+
+int passed_tests = 0;
+int total_tests = 0;
+
+void print_test_result(const char* test_name, int passed, uint64_t got, uint64_t expected) {
+    total_tests++;
+    if (passed) {
+        passed_tests++;
+        printf("%s✓ %s: PASSED%s\n", GREEN, test_name, RESET);
+    } else {
+        printf("%s✗ %s: FAILED%s\n", RED, test_name, RESET);
+        printf("Got %llu, expected %llu\n", (unsigned long long)got, (unsigned long long)expected);
+    }
+}
+
+void check_value(const char* test_name, uint64_t got, uint64_t expected) {
+    print_test_result(test_name, got == expected, got, expected);
+}
+
+void test_empty() {
+    LatencyHistogram* histogram = new_latency_histogram();
+    check_value("Empty percentile", latency_histogram_percentile(histogram, 50), 0);
+    check_value("Empty mean", (uint64_t)latency_histogram_mean(histogram), 0);
+    free_latency_histogram(histogram);
+}
+
+// Below 2^10 every value has its own bucket, from 2^10 to 2^11 too (buckets of width 1),
+// above that the buckets double in width with each power of two
+void test_bucket_boundaries() {
+    uint64_t exact[] = {0, 1, 1023, 1024, 1025, 2047};
+    for (int i = 0; i < (int)(sizeof(exact) / sizeof(exact[0])); i++) {
+        LatencyHistogram* histogram = new_latency_histogram();
+        latency_histogram_record(histogram, exact[i]);
+        latency_histogram_record(histogram, 1000000);
+        char name[64];
+        snprintf(name, sizeof(name), "Exact bucket for %llu", (unsigned long long)exact[i]);
+        check_value(name, latency_histogram_percentile(histogram, 50), exact[i]);
+        free_latency_histogram(histogram);
+    }
+
+    // 2048 and 2049 share a bucket, reported as its upper end
+    LatencyHistogram* histogram = new_latency_histogram();
+    latency_histogram_record(histogram, 2048);
+    latency_histogram_record(histogram, 4000);
+    check_value("Bucket of 2048", latency_histogram_percentile(histogram, 50), 2049);
+    free_latency_histogram(histogram);
+
+    // ... but never above the largest value recorded
+    histogram = new_latency_histogram();
+    latency_histogram_record(histogram, 2048);
+    check_value("Clamped to max", latency_histogram_percentile(histogram, 100), 2048);
+    free_latency_histogram(histogram);
+}
+
+// Values from 2^40 up are counted as 2^40 - 1, the top of the last bucket
+void test_largest_values() {
+    LatencyHistogram* histogram = new_latency_histogram();
+    uint64_t top = (1ULL << LATENCY_MAX_BITS) - 1;
+    latency_histogram_record(histogram, top);
+    latency_histogram_record(histogram, 1ULL << LATENCY_MAX_BITS);
+    latency_histogram_record(histogram, UINT64_MAX);
+    check_value("Max of 2^40 and above", histogram->max, top);
+    check_value("Percentile of 2^40 and above", latency_histogram_percentile(histogram, 100), top);
+    check_value("Count of 2^40 and above", histogram->counts[LATENCY_BUCKET_COUNT - 1], 3);
+    free_latency_histogram(histogram);
+}
+
+// Every value is reported to within 1/1024 of itself, and never below it
+void test_precision() {
+    int passed = 1;
+    uint64_t worst = 0;
+    for (uint64_t value = 1; value < (1ULL << 39); value = value * 3 + 7) {
+        LatencyHistogram* histogram = new_latency_histogram();
+        latency_histogram_record(histogram, value);
+        latency_histogram_record(histogram, 1ULL << 39);
+        uint64_t reported = latency_histogram_percentile(histogram, 50);
+        if (reported < value || reported - value > value / LATENCY_SUB_BUCKET_COUNT) {
+            passed = 0;
+            worst = value;
+        }
+        free_latency_histogram(histogram);
+    }
+    print_test_result("Precision within 1/1024", passed, worst, 0);
+}
+
+// With 1..1000 recorded the value at rank r is r
+void test_percentile_ranks() {
+    LatencyHistogram* histogram = new_latency_histogram();
+    for (uint64_t value = 1; value <= 1000; value++) {
+        latency_histogram_record(histogram, value);
+    }
+    check_value("p0", latency_histogram_percentile(histogram, 0), 1);
+    check_value("p50", latency_histogram_percentile(histogram, 50), 500);
+    check_value("p90", latency_histogram_percentile(histogram, 90), 900);
+    check_value("p99", latency_histogram_percentile(histogram, 99), 990);
+    check_value("p99.9", latency_histogram_percentile(histogram, 99.9), 999);
+    check_value("p100", latency_histogram_percentile(histogram, 100), 1000);
+    check_value("Above p100", latency_histogram_percentile(histogram, 150), 1000);
+    check_value("Mean", (uint64_t)(latency_histogram_mean(histogram) * 10), 5005);
+    free_latency_histogram(histogram);
+}
+
+void test_merge() {
+    LatencyHistogram* low = new_latency_histogram();
+    LatencyHistogram* high = new_latency_histogram();
+    LatencyHistogram* empty = new_latency_histogram();
+    for (uint64_t value = 1; value <= 500; value++) {
+        latency_histogram_record(low, value);
+        latency_histogram_record(high, value + 500);
+    }
+
+    latency_histogram_merge(low, high);
+    latency_histogram_merge(low, empty);
+    check_value("Merged count", low->total_count, 1000);
+    check_value("Merged min", low->min, 1);
+    check_value("Merged max", low->max, 1000);
+    check_value("Merged p50", latency_histogram_percentile(low, 50), 500);
+    check_value("Merged p99", latency_histogram_percentile(low, 99), 990);
+
+    // Into an empty one, which takes min and max from the other
+    latency_histogram_merge(empty, high);
+    check_value("Merged into empty min", empty->min, 501);
+    check_value("Merged into empty max", empty->max, 1000);
+
+    free_latency_histogram(low);
+    free_latency_histogram(high);
+    free_latency_histogram(empty);
+}
+
+int main() {
+    printf("\n🚀 Starting Latency Histogram Tests...\n\n");
+
+    test_empty();
+    test_bucket_boundaries();
+    test_largest_values();
+    test_precision();
+    test_percentile_ranks();
+    test_merge();
+
+    // Print summary
+    printf("\n📊 Test Summary:\n");
+    printf("Passed: %d\n", passed_tests);
+    printf("Failed: %d\n", total_tests - passed_tests);
+    printf("Total: %d\n", total_tests);
+    return (passed_tests == total_tests) ? 0 : 1;
+}
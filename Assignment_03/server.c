@@ -7,11 +7,24 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <time.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <signal.h>
 #include "threadpool.h"
+#include "markov_snapshot.h"
+#include "batch_generation.h"
 
 #define RFC1123FMT "%a, %d %b %Y %H:%M:%S GMT"
 #define BUFFER_SIZE 4096
 #define MAX_PATH_LENGTH 4096
+#define MAX_TWEETS_PER_REQUEST 10000
+
+// Model behind /tweet, loaded once at startup and only read by the workers
+FrozenChain* tweet_model = NULL;
+
+// Each worker draws the seeds of unseeded /tweet requests from its own stream
+__thread Rng worker_rng;
+__thread int worker_rng_ready = 0;
 
 typedef struct {
     int client_fd;
@@ -239,6 +252,103 @@ void send_file_content(int client_fd, const char* filepath) {
     fclose(file);
 }
 
+// writev until everything is sent, the socket may take it in several parts
+void send_all(int client_fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(client_fd, iov, iovcnt);
+        if (written <= 0) {
+            return;
+        }
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+// Parse "n=<count>&seed=<seed>", both optional, other parameters are ignored
+int parse_tweet_query(const char* query, long* count, uint64_t* seed, int* has_seed) {
+    while (*query != '\0') {
+        const char* end = strchr(query, '&');
+        if (end == NULL) end = query + strlen(query);
+
+        char* value_end;
+        if (strncmp(query, "n=", 2) == 0) {
+            *count = strtol(query + 2, &value_end, 10);
+            if (value_end == query + 2 || value_end != end ||
+                *count < 1 || *count > MAX_TWEETS_PER_REQUEST) {
+                return -1;
+            }
+        } else if (strncmp(query, "seed=", 5) == 0) {
+            *seed = strtoull(query + 5, &value_end, 10);
+            if (value_end == query + 5 || value_end != end) {
+                return -1;
+            }
+            *has_seed = 1;
+        }
+        query = (*end == '&') ? end + 1 : end;
+    }
+    return 0;
+}
+
+void send_tweets_response(int client_fd, const char* query) {
+    long count = 1;
+    uint64_t seed = 0;
+    int has_seed = 0;
+    if (parse_tweet_query(query, &count, &seed, &has_seed) != 0) {
+        send_error_response(client_fd, 400, "Bad Request", "Invalid tweet query.");
+        return;
+    }
+
+    if (!has_seed) {
+        if (!worker_rng_ready) {
+            rng_seed(&worker_rng, (uint64_t)time(NULL), (uint64_t)(uintptr_t)&worker_rng);
+            worker_rng_ready = 1;
+        }
+        seed = rng_next(&worker_rng);
+    }
+
+    // Same lines as tweets_generator's batch mode with this seed
+    OutputBuffer body;
+    output_buffer_init(&body, OUTPUT_BUFFER_NO_FD, 0);
+    if (generate_tweet_range(tweet_model, seed, 1, count, &body) != 0) {
+        output_buffer_free(&body);
+        send_error_response(client_fd, 500, "Internal Server Error", "Memory allocation failed");
+        return;
+    }
+
+    char headers[BUFFER_SIZE];
+    char timebuf[128];
+    time_t now = time(NULL);
+    strftime(timebuf, sizeof(timebuf), RFC1123FMT, gmtime(&now));
+
+    int headers_len = snprintf(headers, sizeof(headers),
+                               "HTTP/1.0 200 OK\r\n"
+                               "Server: webserver/1.0\r\n"
+                               "Date: %s\r\n"
+                               "Content-Type: text/plain\r\n"
+                               "Content-Length: %zu\r\n"
+                               "X-Tweet-Seed: %llu\r\n"
+                               "Connection: close\r\n"
+                               "\r\n",
+                               timebuf, body.length, (unsigned long long)seed);
+
+    // Headers and body in one call
+    struct iovec iov[2];
+    iov[0].iov_base = headers;
+    iov[0].iov_len = headers_len;
+    iov[1].iov_base = body.data;
+    iov[1].iov_len = body.length;
+    send_all(client_fd, iov, body.length > 0 ? 2 : 1);
+
+    output_buffer_free(&body);
+}
+
 int handle_client(void* arg) {
     client_info* info = (client_info*)arg;
     char buffer[BUFFER_SIZE];
@@ -265,6 +375,12 @@ int handle_client(void* arg) {
         goto cleanup;
     }
 
+    if (tweet_model != NULL && strncmp(path, "/tweet", 6) == 0 &&
+        (path[6] == '\0' || path[6] == '?')) {
+        send_tweets_response(info->client_fd, path[6] == '?' ? path + 7 : "");
+        goto cleanup;
+    }
+
     char full_path[MAX_PATH_LENGTH];
     snprintf(full_path, sizeof(full_path), "%s%s", info->base_path, path);
 
@@ -313,8 +429,8 @@ int handle_client(void* arg) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        printf("Usage: server <port> <pool-size> <max-queue-size> <max-number-of-request>\n");
+    if (argc != 5 && argc != 6) {
+        printf("Usage: server <port> <pool-size> <max-queue-size> <max-number-of-request> [model-snapshot]\n");
         exit(1);
     }
 
@@ -323,6 +439,17 @@ int main(int argc, char *argv[]) {
     int max_queue_size = atoi(argv[3]);
     int max_requests = atoi(argv[4]);
 
+    // A client hanging up mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    if (argc == 6) {
+        tweet_model = load_markov_snapshot(argv[5]);
+        if (tweet_model == NULL) {
+            printf("Failed to load model snapshot %s\n", argv[5]);
+            exit(1);
+        }
+    }
+
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
         perror("socket");
@@ -346,7 +473,7 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    if (listen(server_fd, 5) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
         exit(1);
     }
@@ -381,5 +508,6 @@ int main(int argc, char *argv[]) {
 
     destroy_threadpool(pool);
     close(server_fd);
+    free_frozen_chain(&tweet_model);
     return 0;
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
 #define RESET "\033[0m"
 
 pid_t server_pid = -1;
+const char* model_path = NULL; // snapshot to serve /tweet from, optional
 int passed_tests = 0;
 int total_tests = 0;
 
@@ -133,7 +134,7 @@ void start_server() {
     if (server_pid == 0) {
         char port_str[10];
         snprintf(port_str, sizeof(port_str), "%d", TEST_PORT);
-        execl("./server", "./server", port_str, "4", "8", "100", NULL);
+        execl("./server", "./server", port_str, "4", "8", "100", model_path, NULL);
         perror("Failed to start server");
         exit(1);
     }
@@ -359,7 +360,34 @@ void test_large_file_handling() {
                       response);
 }
 
+void test_tweet_endpoint() {
+    char response[BUFFER_SIZE];
+    char again[BUFFER_SIZE];
+
+    send_request("GET", "/tweet?n=5&seed=42", response);
+    send_request("GET", "/tweet?n=5&seed=42", again);
+    char* body = strstr(response, "\r\n\r\n");
+    char* body_again = strstr(again, "\r\n\r\n");
+    print_test_result("Tweet Endpoint",
+                      strstr(response, "HTTP/1.0 200 OK") != NULL &&
+                      strstr(response, "Content-Type: text/plain") != NULL &&
+                      strstr(response, "X-Tweet-Seed: 42") != NULL &&
+                      body != NULL && body_again != NULL &&
+                      strcmp(body, body_again) == 0,
+                      response);
+
+    send_request("GET", "/tweet?n=0", response);
+    print_test_result("Tweet Endpoint Bad Query",
+                      strstr(response, "HTTP/1.0 400 Bad Request") != NULL,
+                      response);
+}
+
 int main(int argc, char *argv[]) {
+    // ./server_test [model-snapshot] also tests /tweet
+    if (argc > 1) {
+        model_path = argv[1];
+    }
+
     signal(SIGINT, handle_exit);
     signal(SIGTERM, handle_exit);
 
@@ -378,6 +406,9 @@ int main(int argc, char *argv[]) {
     test_index_html();
     test_mime_types();
     test_large_file_handling();
+    if (model_path != NULL) {
+        test_tweet_endpoint();
+    }
 
     // Print summary
     printf("\n📊 Test Summary:\n");